@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define YUE_IMPLEMENTATION
+#include "../yue.h"
+
+// Every workload is measured three ways:
+//   parse   loading the file into a code segment
+//   fresh   running it in a new context each time, builtins included
+//   reuse   running it in one context that is reset after each run
+// Results are written as tab separated values, one line per workload and mode.
+
+typedef struct {
+    const char *name;
+    const char *mode;
+    size_t runs;
+    double ns_per_op;
+    double allocs_per_op;
+    double gcs_per_op;
+} Result;
+
+typedef struct {
+    char *text;
+    size_t size;
+} Source;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static bool read_source(const char *filepath, Source *source)
+{
+    FILE *f = fopen(filepath, "rb");
+    if(!f) {
+        fprintf(stderr, "ERROR: Could not open %s\n", filepath);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    source->text = malloc(size + 1);
+    source->size = fread(source->text, 1, size, f);
+    source->text[source->size] = 0;
+    fclose(f);
+    return true;
+}
+
+// A headless stand-in for a drawing plugin, see native.yue and batch.yue
+static volatile long drawn;
+
+static yue_Value draw_rect(yue_Context *ctx, const yue_Value *args)
+{
+    (void)ctx;
+    drawn += args[0].i + args[1].i + args[2].i * args[3].i;
+    return (yue_Value){0};
+}
+
+static void draw_rects(yue_Context *ctx, const yue_Value *args, size_t count)
+{
+    for(size_t i = 0; i < count; ++i, args += 4) draw_rect(ctx, args);
+}
+
+static const yue_Native natives[] = {
+    {"draw-rect", "iiii>v", draw_rect, draw_rects},
+};
+
+static void open_builtins(yue_Context *ctx)
+{
+    yue_load_builtins(ctx);
+    yue_register(ctx, natives, sizeof(natives) / sizeof(*natives));
+}
+
+static yue_Code *load(const Source *source, void *buf, size_t bufsz)
+{
+    yue_Code *code = yue_code_open(buf, bufsz);
+    yue_File file = {source->text, source->text, source->text + source->size};
+    if(yue_code_load(code, &file) != YUE_OK) {
+        fprintf(stderr, "ERROR: %s\n", yue_code_geterror(code));
+        return NULL;
+    }
+    return code;
+}
+
+static bool run(yue_Context *ctx, yue_Code *code, const char *name)
+{
+    if(yue_code_run(ctx, code, NULL) != YUE_OK) {
+        fprintf(stderr, "ERROR: %s: %s\n", name, yue_geterror(ctx));
+        return false;
+    }
+    return true;
+}
+
+// Repeats a mode until it ran for at least min_ns, counters are summed over every run
+static bool measure(Result *res, const Source *source, const char *mode, size_t heap_size, double min_ns)
+{
+    size_t code_size = 2 * sizeof(yue_Context) + (source->size + 1024) * sizeof(yue_Object);
+    void *code_buf = malloc(code_size);
+    void *heap = malloc(heap_size);
+    yue_Code *code = load(source, code_buf, code_size);
+    if(!code) return false;
+
+    yue_Context *ctx = NULL;
+    if(strcmp(mode, "reuse") == 0) {
+        ctx = yue_open(heap, heap_size);
+        open_builtins(ctx);
+        yue_markbase(ctx);
+        // the first run warms the heap up, it's not counted
+        if(!run(ctx, code, res->name)) return false;
+        yue_reset(ctx);
+    }
+
+    size_t allocs = 0, gcs = 0;
+    double start = now_ns(), elapsed = 0;
+    res->mode = mode;
+    res->runs = 0;
+    while(elapsed < min_ns || res->runs < 3) {
+        if(strcmp(mode, "parse") == 0) {
+            // the code context counts what the reader allocates
+            yue_code_close(code);
+            code = load(source, code_buf, code_size);
+            if(!code) return false;
+            allocs += code->ctx->gc.allocations;
+            gcs    += code->ctx->gc.collections;
+        } else if(strcmp(mode, "fresh") == 0) {
+            ctx = yue_open(heap, heap_size);
+            open_builtins(ctx);
+            if(!run(ctx, code, res->name)) return false;
+            allocs += ctx->gc.allocations;
+            gcs    += ctx->gc.collections;
+            yue_reset(ctx);
+        } else {
+            size_t allocs_before = ctx->gc.allocations, gcs_before = ctx->gc.collections;
+            if(!run(ctx, code, res->name)) return false;
+            allocs += ctx->gc.allocations - allocs_before;
+            gcs    += ctx->gc.collections - gcs_before;
+            yue_reset(ctx);
+        }
+        res->runs += 1;
+        elapsed = now_ns() - start;
+    }
+    res->ns_per_op     = elapsed / res->runs;
+    res->allocs_per_op = (double)allocs / res->runs;
+    res->gcs_per_op    = (double)gcs / res->runs;
+    free(heap);
+    yue_code_close(code);
+    free(code_buf);
+    return true;
+}
+
+// Compares the results with a file written by an earlier run. Times may be slower by
+// the tolerance (a fraction), allocation counts don't depend on the machine and may
+// only grow by 1%
+static int compare(const char *filepath, const Result *results, size_t count_results, double tolerance)
+{
+    FILE *f = fopen(filepath, "r");
+    if(!f) {
+        fprintf(stderr, "ERROR: Could not open baseline %s\n", filepath);
+        return 1;
+    }
+    int regressions = 0;
+    char line[512];
+    while(fgets(line, sizeof(line), f)) {
+        char name[128], mode[16];
+        size_t runs;
+        double ns, allocs, gcs;
+        if(sscanf(line, "%127s\t%15s\t%zu\t%lf\t%lf\t%lf", name, mode, &runs, &ns, &allocs, &gcs) != 6) continue;
+        for(size_t i = 0; i < count_results; ++i) {
+            const Result *res = &results[i];
+            if(strcmp(res->name, name) != 0 || strcmp(res->mode, mode) != 0) continue;
+            double change = (res->ns_per_op - ns) / ns;
+            bool slower  = change > tolerance;
+            bool heavier = res->allocs_per_op > allocs * 1.01 + 1;
+            fprintf(stderr, "%-12s %-6s %+7.1f%% time%s%s\n", name, mode, change * 100,
+                    slower ? " SLOWER" : "", heavier ? " MORE ALLOCATIONS" : "");
+            if(slower || heavier) regressions += 1;
+        }
+    }
+    fclose(f);
+    if(regressions > 0) fprintf(stderr, "%d regression(s) against %s\n", regressions, filepath);
+    return regressions > 0;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "USAGE: %s [OPTIONS] workload.yue [workload.yue ...]\n", program);
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "    --heap <KB>         heap size of the contexts (default 1024)\n");
+    fprintf(stderr, "    --time <ms>         minimum time spent on each workload and mode (default 200)\n");
+    fprintf(stderr, "    --baseline <file>   compare with results saved from an earlier run\n");
+    fprintf(stderr, "    --tolerance <f>     allowed slowdown against the baseline (default 0.25)\n");
+}
+
+// bench/fib.yue is reported as fib
+static const char *workload_name(const char *filepath)
+{
+    const char *name = strrchr(filepath, '/');
+    name = name ? name + 1 : filepath;
+    char *copy = strdup(name);
+    char *dot = strrchr(copy, '.');
+    if(dot) *dot = 0;
+    return copy;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *program = argv[0];
+    size_t heap_size = 1024 * 1024;
+    double min_ns = 200 * 1e6;
+    const char *baseline = NULL;
+    double tolerance = 0.25;
+    const char **filepaths = calloc(argc, sizeof(*filepaths));
+    size_t count_filepaths = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if(strcmp(arg, "--heap") == 0 && i + 1 < argc) {
+            heap_size = strtoul(argv[++i], NULL, 10) * 1024;
+        } else if(strcmp(arg, "--time") == 0 && i + 1 < argc) {
+            min_ns = strtod(argv[++i], NULL) * 1e6;
+        } else if(strcmp(arg, "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if(strcmp(arg, "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL);
+        } else if(arg[0] == '-') {
+            fprintf(stderr, "ERROR: unknown option %s\n", arg);
+            usage(program);
+            return 1;
+        } else {
+            filepaths[count_filepaths++] = arg;
+        }
+    }
+    if(count_filepaths == 0) {
+        usage(program);
+        return 1;
+    }
+
+    static const char *modes[] = {"parse", "fresh", "reuse"};
+    size_t count_modes = sizeof(modes) / sizeof(*modes);
+    Result *results = calloc(count_filepaths * count_modes, sizeof(*results));
+    size_t count_results = 0;
+    printf("name\tmode\truns\tns/op\tallocs/op\tgcs/op\n");
+    for(size_t i = 0; i < count_filepaths; ++i) {
+        Source source = {0};
+        if(!read_source(filepaths[i], &source)) return 1;
+        for(size_t j = 0; j < count_modes; ++j) {
+            Result *res = &results[count_results];
+            res->name = workload_name(filepaths[i]);
+            if(!measure(res, &source, modes[j], heap_size, min_ns)) return 1;
+            printf("%s\t%s\t%zu\t%.0f\t%.1f\t%.2f\n", res->name, res->mode, res->runs,
+                    res->ns_per_op, res->allocs_per_op, res->gcs_per_op);
+            fflush(stdout);
+            count_results += 1;
+        }
+        free(source.text);
+    }
+
+    int result = 0;
+    if(baseline) result = compare(baseline, results, count_results, tolerance);
+    free(results);
+    free(filepaths);
+    return result;
+}
@@ -51,6 +51,9 @@ static void dump_obj(yue_Object *obj, int level) {
                     obj = obj->as_pair.tail;
                 }
             } break;
+        default:
+            printf("%s\n", _yue_type_names[obj->type]);
+            break;
     }
 }
 
@@ -110,78 +113,544 @@ void dump_ctx(yue_Context *ctx)
 #ifdef _WIN32
 #include <windows.h>
 typedef HMODULE yue_DLL;
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#define THREAD_PROC DWORD WINAPI
 #else
 #include <dlfcn.h>
+#include <pthread.h>
 typedef void *yue_DLL;
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#define THREAD_PROC void *
+#endif
+
+static void mutex_init(Mutex *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void mutex_lock(Mutex *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static void mutex_unlock(Mutex *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
 #endif
+}
 
-#define DLL_CAP 32
-static yue_DLL dlls[DLL_CAP] = {0};
+static bool thread_start(Thread *thread, THREAD_PROC (*proc)(void *arg), void *arg)
+{
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, proc, arg, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, proc, arg) == 0;
+#endif
+}
+
+static void thread_join(Thread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// dlls are shared by every context in the process
+static yue_DLL *dlls = NULL;
 static size_t dlls_count = 0;
+static size_t dlls_cap = 0;
+static Mutex dlls_mutex;
 
+// Plugins export a descriptor that's bound lazily, older ones a loader that binds everything
+typedef const yue_Plugin *(*yue_DescribeDLL)(void);
 typedef void (*yue_RequireDLLLoader)(yue_Context *ctx);
 yue_Object *yue_builtin_require_dll(yue_Context *ctx, yue_Object *arg)
 {
     char buf[256] = {0};
     const char *filepath = yue_tostring(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), buf, sizeof(buf));
-    if(dlls_count > DLL_CAP) yue_error(ctx, "Could not load more dll. This happened during loading %s\n", filepath);
 #ifdef _WIN32
     yue_DLL dll = LoadLibrary(filepath);
     if(dll == NULL) yue_error(ctx, "Failed to load %s\n", filepath);
+    yue_DescribeDLL describe = (yue_DescribeDLL)GetProcAddress(dll, "yue_describe_dll");
     yue_RequireDLLLoader proc = (yue_RequireDLLLoader)GetProcAddress(dll, "yue_require_dll");
-    if(proc == NULL) yue_error(ctx, "Failed to load yue_require_dll from %s\n", filepath);
-    proc(ctx);
-    dlls[dlls_count++] = dll;
+    if(describe == NULL && proc == NULL) yue_error(ctx, "Failed to load yue_describe_dll or yue_require_dll from %s\n", filepath);
 #else
     yue_DLL dll = dlopen(filepath, RTLD_NOW);
     if(dll == NULL) yue_error(ctx, "Failed to load %s: %s\n", filepath, dlerror());
-    yue_RequireDLLLoader proc = (yue_RequireDLLLoader)dlsym(dll, "yue_require_dll");
-    if(proc == NULL) yue_error(ctx, "Failed to load yue_require_dll from %s: %s\n", filepath, dlerror());
-    proc(ctx);
-    dlls[dlls_count++] = dll;
+    // ISO C has no conversion from dlsym's object pointer to a function pointer,
+    // POSIX guarantees they have the same representation so they're read through a union
+    union { void *sym; yue_DescribeDLL fn; } describe_sym = { dlsym(dll, "yue_describe_dll") };
+    union { void *sym; yue_RequireDLLLoader fn; } proc_sym = { dlsym(dll, "yue_require_dll") };
+    yue_DescribeDLL describe = describe_sym.fn;
+    yue_RequireDLLLoader proc = proc_sym.fn;
+    if(describe == NULL && proc == NULL) yue_error(ctx, "Failed to load yue_describe_dll or yue_require_dll from %s\n", filepath);
 #endif
+
+    mutex_lock(&dlls_mutex);
+    bool loaded = false;
+    for(size_t i = 0; i < dlls_count; ++i) {
+        if(dlls[i] == dll) loaded = true;
+    }
+    if(!loaded && dlls_count == dlls_cap) {
+        size_t cap = dlls_cap ? dlls_cap * 2 : 16;
+        yue_DLL *grown = realloc(dlls, cap * sizeof(*dlls));
+        if(grown) {
+            dlls     = grown;
+            dlls_cap = cap;
+        }
+    }
+    bool full = !loaded && dlls_count == dlls_cap;
+    if(!loaded && !full) dlls[dlls_count++] = dll;
+    mutex_unlock(&dlls_mutex);
+
+    // the handle is already kept by an earlier load, drop the extra reference
+    if(loaded || full) {
+#ifdef _WIN32
+        FreeLibrary(dll);
+#else
+        dlclose(dll);
+#endif
+    }
+    if(full) yue_error(ctx, "Could not grow the dll registry while loading %s\n", filepath);
+    yue_trace_event(ctx, YUE_TRACE_PLUGIN, filepath, 0);
+    if(describe) {
+        yue_register_plugin(ctx, describe());
+    } else {
+        proc(ctx);
+    }
     return yue_nil(ctx);
 }
 
-int main(int argc, char *argv[])
+static void unload_dlls(void)
 {
-    if(argc < 2) {
-        fprintf(stderr, "ERROR: provide input file path\n");
-        fprintf(stderr, "USAGE: %s program.yue\n", argv[0]);
-        return -1;
-    }
-    size_t size = 0;
-    yue_File source = {0};
-    if(!read_entire_file(argv[1], &source)) {
-        fprintf(stderr, "ERROR: failed to read file %s\n", argv[1]);
-        return -1;
+    for(size_t i = 0; i < dlls_count; ++i) {
+        yue_DLL dll = dlls[i];
+#ifdef _WIN32
+        FreeLibrary(dll);
+#else
+        dlclose(dll);
+#endif
     }
+    free(dlls);
+    dlls = NULL;
+    dlls_count = 0;
+    dlls_cap = 0;
+}
 
-    static char buf[32 * 1024];
-    yue_Context *ctx = yue_open(buf, sizeof(buf));
-    yue_load_builtins(ctx);
+// threads of pmap and preduce, 0 for one per core
+static int count_workers = 0;
+// --gc-stats, every context reports its collector before it's released
+static bool show_gc_stats = false;
 
+static void setup_context(yue_Context *ctx)
+{
+    yue_load_builtins(ctx);
+    yue_setworkers(ctx, count_workers);
+#if defined(__linux__)
+    yue_load_io(ctx);
+#endif
     size_t gc = yue_savegc(ctx);
     yue_set(ctx, yue_symbol(ctx, "require-dll"), yue_cfunc(ctx, yue_builtin_require_dll));
     yue_restoregc(ctx, gc);
+}
 
+// Parses the whole file once, the result can be run by every context
+static yue_Code *load_code(const char *filepath)
+{
+    yue_File source = {0};
+    if(!read_entire_file(filepath, &source)) return NULL;
+    // every character makes at most one object, plus the builtins and expansions
+    // when the file defines macros
+    size_t bufsz = 2 * sizeof(yue_Context) + (source.eof - source.ptr + 1024) * sizeof(yue_Object);
+    yue_Code *code = yue_code_open(malloc(bufsz), bufsz);
+    yue_code_setname(code, filepath);
     yue_File copy = source;
-    for(;;) {
-        yue_restoregc(ctx, gc);
-        yue_Object *obj = yue_read(ctx, &copy);
-        if(yue_isnil(obj)) break;
-        yue_eval(ctx, obj);
+    if(yue_code_load(code, &copy) != YUE_OK) {
+        fprintf(stderr, "ERROR: %s: %s\n", filepath, yue_code_geterror(code));
+        yue_code_close(code);
+        free(code);
+        code = NULL;
     }
+    free((void*)source.fst);
+    return code;
+}
 
-    for(int i = 0; i < dlls_count; ++i) {
-        yue_DLL dll = dlls[i];
-#ifdef _WIN32
-        FreeLibrary(dll);
-#else
-        dlclose(dll);
-#endif
+static void write_profile(yue_Context *ctx, const char *filepath)
+{
+    yue_profile_stop(ctx);
+    FILE *f = fopen(filepath, "w");
+    if(f) {
+        yue_profile_folded(ctx, f);
+        fclose(f);
+    } else {
+        fprintf(stderr, "ERROR: Could not write the profile to %s\n", filepath);
+    }
+    yue_profile_report(ctx, stderr);
+    yue_profile_clear(ctx);
+}
+
+// log has the reports written after every collection, the final one goes after them
+static void write_heap_profile(yue_Context *ctx, FILE *log, const char *snapshot_path)
+{
+    yue_heap_stop(ctx);
+    if(log) {
+        fprintf(log, "at exit:\n");
+        yue_heap_report(ctx, log);
+        fclose(log);
+    }
+    if(snapshot_path) {
+        FILE *f = fopen(snapshot_path, "w");
+        if(f) {
+            yue_heap_snapshot(ctx, f);
+            fclose(f);
+        } else {
+            fprintf(stderr, "ERROR: Could not write the heap snapshot to %s\n", snapshot_path);
+        }
+    }
+    yue_heap_clear(ctx);
+}
+
+static void save_trace(yue_Context *ctx, const char *filepath)
+{
+    yue_trace_stop(ctx);
+    FILE *f = fopen(filepath, "wb");
+    if(!f || !yue_trace_save(ctx, f)) fprintf(stderr, "ERROR: Could not write the trace to %s\n", filepath);
+    if(f) fclose(f);
+    yue_trace_clear(ctx);
+}
+
+// yue.exe --trace-json trace out.json
+static int convert_trace(const char *input, const char *output)
+{
+    FILE *in = fopen(input, "rb");
+    if(!in) {
+        fprintf(stderr, "ERROR: Could not open %s\n", input);
+        return -1;
+    }
+    FILE *out = fopen(output, "w");
+    if(!out) {
+        fprintf(stderr, "ERROR: Could not open %s\n", output);
+        fclose(in);
+        return -1;
     }
+    bool ok = yue_trace_json(in, out);
+    if(!ok) fprintf(stderr, "ERROR: %s is not a trace written by this version\n", input);
+    fclose(in);
+    fclose(out);
+    return ok ? 0 : -1;
+}
 
-    free((void*)source.ptr);
+// Returns the exit code of the script
+static int report_status(yue_Context *ctx, const char *filepath, yue_Status status)
+{
+    if(status == YUE_ERROR) {
+        fprintf(stderr, "ERROR: %s: %s\n", filepath, yue_geterror(ctx));
+        return EXIT_FAILURE;
+    }
+    if(status == YUE_EXIT) return yue_getexitcode(ctx);
     return 0;
 }
+
+typedef struct {
+    const char *filepath;
+    yue_Code *code;
+    // bound to `input` when running a script once per input
+    const char *input;
+    int result;
+} Job;
+
+static void prepare_job(yue_Context *ctx, Job *job, long fuel)
+{
+    if(job->input) {
+        size_t gc = yue_savegc(ctx);
+        yue_set(ctx, yue_symbol(ctx, "input"), yue_string(ctx, job->input));
+        yue_restoregc(ctx, gc);
+    }
+    yue_setfuel(ctx, fuel);
+}
+
+static int run_job(yue_Context *ctx, Job *job, long fuel)
+{
+    prepare_job(ctx, job, fuel);
+    return report_status(ctx, job->filepath, yue_code_run(ctx, job->code, NULL));
+}
+
+typedef struct {
+    Job *jobs;
+    size_t count_jobs;
+    size_t next_job;
+    Mutex mutex;
+    size_t heap_size;
+    long fuel;
+} Runner;
+
+static THREAD_PROC runner_worker(void *arg)
+{
+    Runner *runner = arg;
+    void *buf = malloc(runner->heap_size);
+    yue_Context *ctx = yue_open(buf, runner->heap_size);
+    setup_context(ctx);
+    yue_markbase(ctx);
+    for(;;) {
+        mutex_lock(&runner->mutex);
+        Job *job = runner->next_job < runner->count_jobs ? &runner->jobs[runner->next_job++] : NULL;
+        mutex_unlock(&runner->mutex);
+        if(!job) break;
+
+        yue_reset(ctx);
+        job->result = run_job(ctx, job, runner->fuel);
+    }
+    if(show_gc_stats) yue_gcstats_report(ctx, stderr);
+    yue_reset(ctx);
+    free(buf);
+    return 0;
+}
+
+#define TASK_STACK_SIZE (256 * 1024)
+
+// Interleaves every job on this thread, each job gets slice steps per turn
+static int run_interleaved(Job *jobs, size_t count_jobs, size_t heap_size, long slice, long fuel)
+{
+    yue_Scheduler sched;
+    yue_sched_init(&sched, slice);
+    yue_Task **tasks = calloc(count_jobs, sizeof(*tasks));
+    for(size_t i = 0; i < count_jobs; ++i) {
+        yue_Context *ctx = yue_open(malloc(heap_size), heap_size);
+        setup_context(ctx);
+        prepare_job(ctx, &jobs[i], fuel);
+        tasks[i] = yue_task_open(malloc(TASK_STACK_SIZE), TASK_STACK_SIZE, ctx, jobs[i].code);
+        yue_sched_add(&sched, tasks[i]);
+    }
+    yue_sched_run(&sched);
+
+    int result = 0;
+    for(size_t i = 0; i < count_jobs; ++i) {
+        yue_Context *ctx = yue_task_context(tasks[i]);
+        jobs[i].result = report_status(ctx, jobs[i].filepath, yue_task_status(tasks[i]));
+        if(show_gc_stats) yue_gcstats_report(ctx, stderr);
+        if(jobs[i].result != 0 && result == 0) result = jobs[i].result;
+        yue_reset(ctx);
+        free(ctx);
+        free(tasks[i]);
+    }
+    free(tasks);
+    return result;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "USAGE: %s [OPTIONS] program.yue [program.yue ...]\n", program);
+    fprintf(stderr, "       %s [OPTIONS] program.yue --each input [input ...]\n", program);
+    fprintf(stderr, "       %s --trace-json trace out.json\n", program);
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "    -j <N>          run the programs on N threads, each with its own context\n");
+    fprintf(stderr, "    --heap <KB>     heap size of every context (default 256)\n");
+    fprintf(stderr, "    --each          run the program once per input, the input is bound to `input`\n");
+    fprintf(stderr, "    --fuel <N>      fail a program after N evaluation steps\n");
+    fprintf(stderr, "    --slice <N>     interleave the programs on one thread, N steps at a time\n");
+    fprintf(stderr, "    --workers <N>   threads used by pmap and preduce (default one per core)\n");
+    fprintf(stderr, "    --profile <file>         time every call, write folded stacks to file and a summary to stderr\n");
+    fprintf(stderr, "    --profile-sample <file>  same with a sampling profiler, counts are samples\n");
+    fprintf(stderr, "    --heap-profile <file>    tag allocations with their site, write what each site retains after every collection\n");
+    fprintf(stderr, "    --heap-snapshot <file>   write the live objects by site and type at exit\n");
+    fprintf(stderr, "    --perf-counters          count cycles, instructions, branch, cache and TLB misses per run, form and collection\n");
+    fprintf(stderr, "    --trace <file>           record calls, collections, allocations, plugin loads and errors, saved at exit\n");
+    fprintf(stderr, "    --gc-stats      print the collector's counters and live objects of every context at exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *program = argv[0];
+    size_t count_threads = 0;
+    size_t heap_size = 256 * 1024;
+    long fuel = -1;
+    long slice = 0;
+    const char **filepaths = calloc(argc, sizeof(*filepaths));
+    size_t count_filepaths = 0;
+    const char **inputs = NULL;
+    size_t count_inputs = 0;
+    const char *profile_path = NULL;
+    yue_ProfileMode profile_mode = YUE_PROFILE_INSTRUMENT;
+    const char *heap_path = NULL;
+    const char *snapshot_path = NULL;
+    bool perf_counters = false;
+    const char *trace_path = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            count_threads = strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(arg, "--heap") == 0 && i + 1 < argc) {
+            heap_size = strtoul(argv[++i], NULL, 10) * 1024;
+        } else if(strcmp(arg, "--fuel") == 0 && i + 1 < argc) {
+            fuel = strtol(argv[++i], NULL, 10);
+        } else if(strcmp(arg, "--slice") == 0 && i + 1 < argc) {
+            slice = strtol(argv[++i], NULL, 10);
+        } else if(strcmp(arg, "--workers") == 0 && i + 1 < argc) {
+            count_workers = atoi(argv[++i]);
+        } else if(strcmp(arg, "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+            profile_mode = YUE_PROFILE_INSTRUMENT;
+        } else if(strcmp(arg, "--profile-sample") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+            profile_mode = YUE_PROFILE_SAMPLE;
+        } else if(strcmp(arg, "--heap-profile") == 0 && i + 1 < argc) {
+            heap_path = argv[++i];
+        } else if(strcmp(arg, "--heap-snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if(strcmp(arg, "--perf-counters") == 0) {
+            perf_counters = true;
+        } else if(strcmp(arg, "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if(strcmp(arg, "--trace-json") == 0 && i + 2 < argc) {
+            int result = convert_trace(argv[i + 1], argv[i + 2]);
+            free(filepaths);
+            return result;
+        } else if(strcmp(arg, "--gc-stats") == 0) {
+            show_gc_stats = true;
+        } else if(strcmp(arg, "--each") == 0) {
+            inputs = (const char **)&argv[i + 1];
+            count_inputs = argc - (i + 1);
+            break;
+        } else if(arg[0] == '-') {
+            fprintf(stderr, "ERROR: unknown option %s\n", arg);
+            usage(program);
+            return -1;
+        } else {
+            filepaths[count_filepaths++] = arg;
+        }
+    }
+    if(count_filepaths < 1 || (inputs && count_filepaths != 1)) {
+        fprintf(stderr, "ERROR: provide input file path\n");
+        usage(program);
+        return -1;
+    }
+    if(slice > 0 && count_threads > 0) {
+        fprintf(stderr, "ERROR: --slice runs everything on one thread, it can't be used with -j\n");
+        usage(program);
+        return -1;
+    }
+    if((profile_path || heap_path || snapshot_path || perf_counters || trace_path) && (slice > 0 || count_threads > 0 || inputs || count_filepaths != 1)) {
+        fprintf(stderr, "ERROR: the profilers run a single program, without -j, --slice or --each\n");
+        usage(program);
+        return -1;
+    }
+    if(heap_size <= sizeof(yue_Context) * 2) {
+        fprintf(stderr, "ERROR: heap size is too small\n");
+        return -1;
+    }
+
+    size_t count_jobs = inputs ? count_inputs : count_filepaths;
+    Job *jobs = calloc(count_jobs, sizeof(*jobs));
+    for(size_t i = 0; i < count_filepaths; ++i) {
+        yue_Code *code = load_code(filepaths[i]);
+        if(!code) {
+            free(jobs);
+            free(filepaths);
+            return -1;
+        }
+        if(inputs) {
+            // all inputs run the same code
+            for(size_t j = 0; j < count_inputs; ++j) {
+                jobs[j].filepath = filepaths[i];
+                jobs[j].code = code;
+                jobs[j].input = inputs[j];
+            }
+        } else {
+            jobs[i].filepath = filepaths[i];
+            jobs[i].code = code;
+        }
+    }
+
+    mutex_init(&dlls_mutex);
+    int result = 0;
+    if(slice > 0) {
+        result = run_interleaved(jobs, count_jobs, heap_size, slice, fuel);
+    } else if(count_threads == 0 && count_jobs == 1) {
+        void *buf = malloc(heap_size);
+        yue_Context *ctx = yue_open(buf, heap_size);
+        setup_context(ctx);
+        if(profile_path && !yue_profile_start(ctx, profile_mode)) {
+            fprintf(stderr, "ERROR: this profiler is not available\n");
+            profile_path = NULL;
+        }
+        FILE *heap_log = heap_path ? fopen(heap_path, "w") : NULL;
+        if(heap_path && !heap_log) fprintf(stderr, "ERROR: Could not write the heap profile to %s\n", heap_path);
+        bool heap_profiled = (heap_log || snapshot_path) && yue_heap_start(ctx, heap_log);
+        if(heap_log && !heap_profiled) fclose(heap_log);
+        if(trace_path && !yue_trace_start(ctx)) {
+            fprintf(stderr, "ERROR: Could not allocate the trace buffer\n");
+            trace_path = NULL;
+        }
+        bool counting = perf_counters && yue_counters_start(ctx);
+        if(perf_counters && !counting) {
+            fprintf(stderr, "WARNING: hardware counters are not permitted here (see /proc/sys/kernel/perf_event_paranoid), running without them\n");
+        }
+        result = run_job(ctx, &jobs[0], fuel);
+        if(counting) {
+            yue_counters_stop(ctx);
+            yue_counters_report(ctx, stderr);
+            yue_counters_clear(ctx);
+        }
+        if(profile_path) write_profile(ctx, profile_path);
+        if(heap_profiled) write_heap_profile(ctx, heap_log, snapshot_path);
+        if(trace_path) save_trace(ctx, trace_path);
+        if(show_gc_stats) yue_gcstats_report(ctx, stderr);
+        yue_reset(ctx);
+        free(buf);
+    } else {
+        if(count_threads == 0) count_threads = 1;
+        if(count_threads > count_jobs) count_threads = count_jobs;
+        Runner runner = {
+            .jobs = jobs,
+            .count_jobs = count_jobs,
+            .heap_size = heap_size,
+            .fuel = fuel,
+        };
+        mutex_init(&runner.mutex);
+        Thread *threads = calloc(count_threads, sizeof(*threads));
+        size_t count_started = 0;
+        for(size_t i = 0; i < count_threads; ++i) {
+            if(!thread_start(&threads[count_started], runner_worker, &runner)) {
+                fprintf(stderr, "ERROR: failed to start worker thread\n");
+                break;
+            }
+            count_started += 1;
+        }
+        if(count_started == 0) runner_worker(&runner);
+        for(size_t i = 0; i < count_started; ++i) thread_join(threads[i]);
+        free(threads);
+        for(size_t i = 0; i < count_jobs; ++i) {
+            if(jobs[i].result != 0 && result == 0) result = jobs[i].result;
+        }
+    }
+
+    unload_dlls();
+    for(size_t i = 0; i < count_jobs; ++i) {
+        if(inputs && i > 0) break;
+        if(yue_code_release(jobs[i].code)) {
+            yue_code_close(jobs[i].code);
+            free(jobs[i].code);
+        }
+    }
+    free(jobs);
+    free(filepaths);
+    return result;
+}
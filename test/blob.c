@@ -0,0 +1,52 @@
+#define YUE_IMPLEMENTATION
+#define YUE_DEF static
+#define YUE_BUILD_DLL
+#include "../yue.h"
+
+// Natives that damage the blobs of `serialize` so that test/serialize.yue can check how
+// `deserialize` rejects them. The blob is changed in place, it's still freed by the runtime.
+
+static yue_Blob *blob_of(yue_Context *ctx, yue_Object *obj)
+{
+    if(obj->type != YUE_OBJECT_RESOURCE || !obj->as_resource.data) yue_error(ctx, "Expected a blob");
+    return obj->as_resource.data;
+}
+
+// (blob-size blob)
+static yue_Value f_blob_size(yue_Context *ctx, const yue_Value *args)
+{
+    return (yue_Value){ .i = (int)blob_of(ctx, args[0].o)->size };
+}
+
+// (blob-poke blob index byte)
+static yue_Value f_blob_poke(yue_Context *ctx, const yue_Value *args)
+{
+    yue_Blob *blob = blob_of(ctx, args[0].o);
+    if(args[1].i < 0 || (size_t)args[1].i >= blob->size) yue_error(ctx, "Index %d is out of the blob", args[1].i);
+    blob->data[args[1].i] = (unsigned char)args[2].i;
+    return (yue_Value){0};
+}
+
+// (blob-truncate blob size), only ever shrinks it
+static yue_Value f_blob_truncate(yue_Context *ctx, const yue_Value *args)
+{
+    yue_Blob *blob = blob_of(ctx, args[0].o);
+    if(args[1].i >= 0 && (size_t)args[1].i < blob->size) blob->size = (size_t)args[1].i;
+    return (yue_Value){0};
+}
+
+static const yue_Native natives[] = {
+    {"blob-size",     "o>i",   f_blob_size,     NULL},
+    {"blob-poke",     "oii>v", f_blob_poke,     NULL},
+    {"blob-truncate", "oi>v",  f_blob_truncate, NULL},
+};
+
+static const yue_Plugin plugin = {
+    natives, sizeof(natives) / sizeof(*natives),
+    NULL,    0,
+};
+
+YUE_API const yue_Plugin *yue_describe_dll(void)
+{
+    return &plugin;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define YUE_IMPLEMENTATION
+#include "../yue.h"
+
+// usage: test/pool.exe base.yue requests.yue
+// Runs base.yue in a pooled context before its base is marked, then every top-level form of
+// requests.yue as a request of its own: the context is acquired, the form is read and
+// evaluated, and the context is released (reset) before the next one.
+
+#define HEAP_SIZE (256 * 1024)
+
+static yue_File base;
+
+static bool read_file(const char *filepath, yue_File *file)
+{
+    FILE *f = fopen(filepath, "rb");
+    if(!f) {
+        fprintf(stderr, "ERROR: Could not open %s\n", filepath);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size = (long)fread(text, 1, size, f);
+    text[size] = 0;
+    fclose(f);
+    file->fst = text;
+    file->ptr = text;
+    file->eof = text + size;
+    return true;
+}
+
+// (keep obj) conses obj onto the global `kept`, batches of it keep objects unboxed
+static yue_Value keep(yue_Context *ctx, const yue_Value *args)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *sym = yue_symbol(ctx, "kept");
+    yue_set(ctx, sym, yue_pair(ctx, args[0].o, yue_get(ctx, sym)));
+    yue_restoregc(ctx, gc);
+    return (yue_Value){0};
+}
+
+static const yue_Native natives[] = {
+    {"keep", "o>v", keep, NULL},
+};
+
+// Evaluates one form of file, false when there's none left
+static bool run_form(yue_Context *ctx, yue_File *file)
+{
+    yue_Object *form;
+    fflush(stdout);
+    if(yue_pread(ctx, file, &form) != YUE_OK) {
+        fprintf(stderr, "ERROR: %s\n", yue_geterror(ctx));
+        return false;
+    }
+    if(yue_isnil(form)) return false;
+    if(yue_peval(ctx, form, NULL) == YUE_ERROR) {
+        fflush(stdout);
+        fprintf(stderr, "ERROR: %s\n", yue_geterror(ctx));
+    }
+    return true;
+}
+
+static void setup(yue_Context *ctx)
+{
+    yue_register(ctx, natives, sizeof(natives) / sizeof(*natives));
+    yue_set(ctx, yue_symbol(ctx, "kept"), yue_nil(ctx));
+    yue_File file = base;
+    while(run_form(ctx, &file));
+}
+
+int main(int argc, char **argv)
+{
+    yue_File requests;
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s base.yue requests.yue\n", argv[0]);
+        return 1;
+    }
+    if(!read_file(argv[1], &base) || !read_file(argv[2], &requests)) return 1;
+
+    // a single context, so every request runs where the previous one was reset
+    yue_Pool pool;
+    void *buf = malloc(HEAP_SIZE);
+    if(yue_pool_init(&pool, buf, HEAP_SIZE, HEAP_SIZE, setup) != 1) return 1;
+    for(;;) {
+        yue_Context *ctx = yue_pool_acquire(&pool);
+        bool more = run_form(ctx, &requests);
+        yue_pool_release(&pool, ctx);
+        if(!more) break;
+    }
+    yue_close(yue_pool_acquire(&pool));
+    free(buf);
+    free((char*)base.fst);
+    free((char*)requests.fst);
+    return 0;
+}
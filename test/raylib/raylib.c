@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include "raylib.h"
+
+// The window closes after this many frames. Every frame holds down one key of keys.
+#define FRAMES 3
+
+static const int keys[FRAMES] = {KEY_D, KEY_W, KEY_LEFT};
+static int frame = 0;
+
+void InitWindow(int width, int height, const char *title)
+{
+    printf("InitWindow %d %d %s\n", width, height, title);
+}
+
+void CloseWindow(void)
+{
+    printf("CloseWindow\n");
+}
+
+bool WindowShouldClose(void)
+{
+    return frame >= FRAMES;
+}
+
+void BeginDrawing(void)
+{
+    printf("BeginDrawing %d\n", frame);
+}
+
+void EndDrawing(void)
+{
+    printf("EndDrawing %d\n", frame);
+    frame += 1;
+}
+
+void ClearBackground(Color color)
+{
+    printf("ClearBackground %d %d %d %d\n", color.r, color.g, color.b, color.a);
+}
+
+void DrawRectangle(int posX, int posY, int width, int height, Color color)
+{
+    printf("DrawRectangle %d %d %d %d %d %d %d %d\n", posX, posY, width, height, color.r, color.g, color.b, color.a);
+}
+
+bool IsKeyPressed(int key)
+{
+    return frame < FRAMES && keys[frame] == key;
+}
+
+bool IsKeyDown(int key)
+{
+    return frame < FRAMES && keys[frame] == key;
+}
+
+bool IsKeyUp(int key)
+{
+    return !IsKeyDown(key);
+}
+
+bool IsKeyReleased(int key)
+{
+    return frame > 0 && frame <= FRAMES && keys[frame - 1] == key;
+}
+
+float GetFrameTime(void)
+{
+    return 0.5f;
+}
@@ -0,0 +1,39 @@
+// A stand-in for the parts of raylib that yue-raylib.c uses. The functions log their
+// calls to stdout instead of drawing, see raylib.c
+#ifndef RAYLIB_H
+#define RAYLIB_H
+
+#include <stdbool.h>
+
+typedef struct Color {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+} Color;
+
+typedef enum {
+    KEY_A     = 65,
+    KEY_D     = 68,
+    KEY_S     = 83,
+    KEY_W     = 87,
+    KEY_RIGHT = 262,
+    KEY_LEFT  = 263,
+    KEY_DOWN  = 264,
+    KEY_UP    = 265,
+} KeyboardKey;
+
+void InitWindow(int width, int height, const char *title);
+void CloseWindow(void);
+bool WindowShouldClose(void);
+void BeginDrawing(void);
+void EndDrawing(void);
+void ClearBackground(Color color);
+void DrawRectangle(int posX, int posY, int width, int height, Color color);
+bool IsKeyPressed(int key);
+bool IsKeyDown(int key);
+bool IsKeyUp(int key);
+bool IsKeyReleased(int key);
+float GetFrameTime(void);
+
+#endif // RAYLIB_H
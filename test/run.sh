@@ -0,0 +1,22 @@
+#!/bin/sh
+# usage: test/run.sh ./yue.exe test/a.yue test/b.yue ...
+# runs every script and compares what it prints, errors included, with the
+# .out file next to it. Options for the runner go in a .args file.
+yue=$1
+shift
+failed=0
+for script in "$@"; do
+    args=
+    [ -f "${script%.yue}.args" ] && args=$(cat "${script%.yue}.args")
+    # ASan notices that errors unwind from a coroutine's stack, with addresses that change every run
+    if "$yue" $args "$script" 2>&1 | grep -v -e "__asan_handle_no_return" -e "^False positive error reports may follow" \
+            -e "google/sanitizers/issues/189" | diff -u "${script%.yue}.out" - > "${script%.yue}.diff"; then
+        rm -f "${script%.yue}.diff"
+        echo "ok   $script"
+    else
+        cat "${script%.yue}.diff"
+        echo "FAIL $script"
+        failed=$((failed + 1))
+    fi
+done
+[ $failed -eq 0 ] || { echo "$failed test(s) failed"; exit 1; }
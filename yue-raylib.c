@@ -4,136 +4,116 @@
 #define YUE_BUILD_DLL
 #include "yue.h"
 
-static yue_Object *f_init_window(yue_Context *ctx, yue_Object *arg)
+// The runtime converts the arguments by the signatures in natives, see yue_register
+
+static yue_Value f_init_window(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    char buf[256] = {0};
-    int width  = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int height = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    const char *title = yue_tostring(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), buf, sizeof(buf));
-    InitWindow(width, height, title);
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    InitWindow(args[0].i, args[1].i, args[2].s);
+    return (yue_Value){0};
 }
 
-static yue_Object *f_close_window(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_close_window(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
     CloseWindow();
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    return (yue_Value){0};
 }
 
-static yue_Object *f_begin_drawing(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_begin_drawing(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
     BeginDrawing();
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    return (yue_Value){0};
 }
 
-static yue_Object *f_end_drawing(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_end_drawing(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
     EndDrawing();
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    return (yue_Value){0};
+}
+
+static yue_Value f_window_should_close(yue_Context *ctx, const yue_Value *args)
+{
+    return (yue_Value){ .b = WindowShouldClose() };
 }
 
-static yue_Object *f_window_should_close(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_clear_background(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    yue_restoregc(ctx, gc);
-    return WindowShouldClose() ? yue_number(ctx, 1) : yue_nil(ctx);
+    ClearBackground((Color){ .r=args[0].i, .g=args[1].i, .b=args[2].i, .a=args[3].i });
+    return (yue_Value){0};
 }
 
-static yue_Object *f_clear_background(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_draw_rectangle(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    int r = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int g = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int b = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int a = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    ClearBackground((Color){ .r=r, .g=g, .b=b, .a=a });
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    DrawRectangle(args[0].i, args[1].i, args[2].i, args[3].i,
+            (Color){ .r=args[4].i, .g=args[5].i, .b=args[6].i, .a=args[7].i });
+    return (yue_Value){0};
 }
 
-static yue_Object *f_draw_rectangle(yue_Context *ctx, yue_Object *arg)
+static void f_draw_rectangles(yue_Context *ctx, const yue_Value *args, size_t count)
 {
-    size_t gc = yue_savegc(ctx);
-    int x = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int y = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int w = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int h = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int r = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int g = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int b = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    int a = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    DrawRectangle(x, y, w, h, (Color){ .r=r, .g=g, .b=b, .a=a });
-    yue_restoregc(ctx, gc);
-    return yue_nil(ctx);
+    for(size_t i = 0; i < count; ++i, args += 8) {
+        DrawRectangle(args[0].i, args[1].i, args[2].i, args[3].i,
+                (Color){ .r=args[4].i, .g=args[5].i, .b=args[6].i, .a=args[7].i });
+    }
 }
 
-static yue_Object *f_is_key_pressed(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_is_key_pressed(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    int keycode = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    yue_restoregc(ctx, gc);
-    return IsKeyPressed(keycode) ? yue_number(ctx, 1) : yue_nil(ctx);
+    return (yue_Value){ .b = IsKeyPressed(args[0].i) };
 }
 
-static yue_Object *f_is_key_down(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_is_key_down(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    int keycode = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    yue_restoregc(ctx, gc);
-    return IsKeyDown(keycode) ? yue_number(ctx, 1) : yue_nil(ctx);
+    return (yue_Value){ .b = IsKeyDown(args[0].i) };
 }
 
-static yue_Object *f_is_key_up(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_is_key_up(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    int keycode = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    yue_restoregc(ctx, gc);
-    return IsKeyUp(keycode) ? yue_number(ctx, 1) : yue_nil(ctx);
+    return (yue_Value){ .b = IsKeyUp(args[0].i) };
 }
 
-static yue_Object *f_is_key_released(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_is_key_released(yue_Context *ctx, const yue_Value *args)
 {
-    size_t gc = yue_savegc(ctx);
-    int keycode = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
-    yue_restoregc(ctx, gc);
-    return IsKeyReleased(keycode) ? yue_number(ctx, 1) : yue_nil(ctx);
+    return (yue_Value){ .b = IsKeyReleased(args[0].i) };
 }
 
-static yue_Object *f_get_frame_time(yue_Context *ctx, yue_Object *arg)
+static yue_Value f_get_frame_time(yue_Context *ctx, const yue_Value *args)
 {
-    return yue_number(ctx, GetFrameTime());
+    return (yue_Value){ .f = GetFrameTime() };
 }
 
+static const yue_Native natives[] = {
+    {"init-window",         "iis>v",      f_init_window,          NULL},
+    {"close-window",        ">v",         f_close_window,         NULL},
+    {"begin-drawing",       ">v",         f_begin_drawing,        NULL},
+    {"end-drawing",         ">v",         f_end_drawing,          NULL},
+    {"window-should-close", ">b",         f_window_should_close,  NULL},
+    {"clear-background",    "iiii>v",     f_clear_background,     NULL},
+    {"draw-rectangle",      "iiiiiiii>v", f_draw_rectangle,       f_draw_rectangles},
+    {"is-key-pressed",      "i>b",        f_is_key_pressed,       NULL},
+    {"is-key-down",         "i>b",        f_is_key_down,          NULL},
+    {"is-key-up",           "i>b",        f_is_key_up,            NULL},
+    {"is-key-released",     "i>b",        f_is_key_released,      NULL},
+    {"get-frame-time",      ">f",         f_get_frame_time,       NULL},
+};
+
+static const yue_Constant constants[] = {
+    {"KEY_W",     KEY_W},
+    {"KEY_A",     KEY_A},
+    {"KEY_S",     KEY_S},
+    {"KEY_D",     KEY_D},
+    {"KEY_UP",    KEY_UP},
+    {"KEY_LEFT",  KEY_LEFT},
+    {"KEY_RIGHT", KEY_RIGHT},
+    {"KEY_DOWN",  KEY_DOWN},
+};
+
+static const yue_Plugin plugin = {
+    natives,   sizeof(natives) / sizeof(*natives),
+    constants, sizeof(constants) / sizeof(*constants),
+};
 
-YUE_API void yue_require_dll(yue_Context *ctx)
+// the host binds the exports as scripts use them, see yue_register_plugin
+YUE_API const yue_Plugin *yue_describe_dll(void)
 {
-    yue_set(ctx, yue_symbol(ctx, "init-window"), yue_cfunc(ctx, f_init_window));
-    yue_set(ctx, yue_symbol(ctx, "close-window"), yue_cfunc(ctx, f_close_window));
-    yue_set(ctx, yue_symbol(ctx, "begin-drawing"), yue_cfunc(ctx, f_begin_drawing));
-    yue_set(ctx, yue_symbol(ctx, "end-drawing"), yue_cfunc(ctx, f_end_drawing));
-    yue_set(ctx, yue_symbol(ctx, "window-should-close"), yue_cfunc(ctx, f_window_should_close));
-    yue_set(ctx, yue_symbol(ctx, "clear-background"), yue_cfunc(ctx, f_clear_background));
-    yue_set(ctx, yue_symbol(ctx, "draw-rectangle"), yue_cfunc(ctx, f_draw_rectangle));
-    yue_set(ctx, yue_symbol(ctx, "is-key-pressed"), yue_cfunc(ctx, f_is_key_pressed));
-    yue_set(ctx, yue_symbol(ctx, "is-key-down"), yue_cfunc(ctx, f_is_key_down));
-    yue_set(ctx, yue_symbol(ctx, "is-key-up"), yue_cfunc(ctx, f_is_key_up));
-    yue_set(ctx, yue_symbol(ctx, "is-key-released"), yue_cfunc(ctx, f_is_key_released));
-    yue_set(ctx, yue_symbol(ctx, "get-frame-time"), yue_cfunc(ctx, f_get_frame_time));
-
-    yue_set(ctx, yue_symbol(ctx, "KEY_W"), yue_number(ctx, KEY_W));
-    yue_set(ctx, yue_symbol(ctx, "KEY_A"), yue_number(ctx, KEY_A));
-    yue_set(ctx, yue_symbol(ctx, "KEY_S"), yue_number(ctx, KEY_S));
-    yue_set(ctx, yue_symbol(ctx, "KEY_D"), yue_number(ctx, KEY_D));
-    yue_set(ctx, yue_symbol(ctx, "KEY_UP"), yue_number(ctx, KEY_UP));
-    yue_set(ctx, yue_symbol(ctx, "KEY_LEFT"), yue_number(ctx, KEY_LEFT));
-    yue_set(ctx, yue_symbol(ctx, "KEY_RIGHT"), yue_number(ctx, KEY_RIGHT));
-    yue_set(ctx, yue_symbol(ctx, "KEY_DOWN"), yue_number(ctx, KEY_DOWN));
+    return &plugin;
 }
@@ -3,7 +3,10 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifndef YUE_STACK_CAP
 #define YUE_STACK_CAP 256
@@ -13,6 +16,15 @@
 #define YUE_MAX_SCOPE_DEPTH 32
 #endif
 
+#ifndef YUE_ERROR_CAP
+#define YUE_ERROR_CAP 256
+#endif
+
+// numbers 0 to YUE_SMALL_INTS - 1 are shared objects kept in the context
+#ifndef YUE_SMALL_INTS
+#define YUE_SMALL_INTS 32
+#endif
+
 #ifndef YUE_API
     #ifdef _WIN32
         #ifdef YUE_BUILD_DLL
@@ -37,8 +49,34 @@
 
 typedef struct yue_Context yue_Context; 
 typedef struct yue_Object yue_Object;
+typedef struct yue_Code yue_Code;
+typedef struct yue_Task yue_Task;
+typedef struct yue_Profile yue_Profile;
+typedef struct yue_HeapProfile yue_HeapProfile;
+typedef struct yue_Counters yue_Counters;
+typedef struct yue_Trace yue_Trace;
 typedef yue_Object *(*yue_CFunc)(yue_Context *ctx, yue_Object *arg);
 
+// Arguments and result of a native, see yue_register
+typedef union {
+    long i;
+    double f;
+    bool b;
+    const char *s;
+    void *u;
+    yue_Object *o;
+} yue_Value;
+typedef yue_Value (*yue_NativeFn)(yue_Context *ctx, const yue_Value *args);
+// Runs count commands of a batch at once, args holds count groups of arguments
+typedef void (*yue_NativeBatchFn)(yue_Context *ctx, const yue_Value *args, size_t count);
+typedef struct {
+    const char *name;
+    const char *signature;
+    yue_NativeFn fn;
+    // optional
+    yue_NativeBatchFn batch;
+} yue_Native;
+
 #define YUE_FLOAT_EPSILON 1e-6
 typedef double yue_Number;
 
@@ -52,8 +90,25 @@ typedef enum {
     YUE_OBJECT_CFUNC,
     YUE_OBJECT_USERDATA,
     YUE_OBJECT_RESOURCE,
+    YUE_OBJECT_COROUTINE,
+    YUE_OBJECT_SEQ,
+    YUE_OBJECT_MEMO,
+    YUE_OBJECT_RECORD,
+    YUE_OBJECT_MACRO,
+    YUE_OBJECT_NATIVE,
+    YUE_OBJECT_BATCH,
+    YUE_OBJECT_MODULE,
+    YUE_OBJECT_TYPE_COUNT,
 } yue_ObjectType;
 
+typedef enum {
+    YUE_OK,
+    // yue_error was raised, the message is in yue_geterror
+    YUE_ERROR,
+    // the script called `exit`, the code is in yue_getexitcode
+    YUE_EXIT,
+} yue_Status;
+
 typedef struct yue_File {
     // the real first character in the entire file
     const char *fst;
@@ -64,17 +119,242 @@ typedef struct yue_File {
     const char *eof;
 } yue_File;
 
+#ifndef YUE_POOL_CAP
+#define YUE_POOL_CAP 64
+#endif
+
+// A fixed set of contexts that are handed out ready to use and are
+// reset back to their base state when released.
+typedef struct yue_Pool {
+    yue_Context *free[YUE_POOL_CAP];
+    size_t count_free;
+} yue_Pool;
+
+// Runs tasks round-robin on the calling thread, each task gets the same
+// amount of fuel per turn
+typedef struct yue_Scheduler {
+    yue_Task *head;
+    yue_Task *tail;
+    long slice;
+} yue_Scheduler;
+
+// A lazy sequence, elements are pulled one at a time from its source
+typedef struct yue_Seq {
+    // stores the next element in *out, returns false once there's none left
+    bool (*next)(yue_Context *ctx, struct yue_Seq *seq, yue_Object **out);
+    // releases what data holds, can be NULL
+    void (*destroy)(struct yue_Seq *seq);
+    bool done;
+    // the list, coroutine or sequence it pulls from and the function it applies
+    yue_Object *source;
+    yue_Object *fn;
+    // progress of ranges and take
+    yue_Number index;
+    yue_Number limit;
+    void *data;
+} yue_Seq;
+
 // recommended bufsz is 64KB
 YUE_DEF yue_Context *yue_open(void *buf, size_t bufsz);
+// Remember the current globals and heap top as the state yue_reset goes back to.
+// Call it once the context is fully initialized (builtins, host functions, ...)
+YUE_DEF void yue_markbase(yue_Context *ctx);
+// Drop everything created after yue_markbase (or yue_open if there's no base). Records, memos
+// and batches from before the base get back what they held then, coroutines from before
+// the base can't be resumed after it.
+YUE_DEF void yue_reset(yue_Context *ctx);
+// Frees what the context keeps outside of its buffer, the buffer itself is the host's
+YUE_DEF void yue_close(yue_Context *ctx);
 YUE_DEF yue_Object *yue_eval(yue_Context *ctx, yue_Object *obj);
+// Calls fn with a list of already evaluated arguments
+YUE_DEF yue_Object *yue_call(yue_Context *ctx, yue_Object *fn, yue_Object *args);
 YUE_DEF yue_Object *yue_get(yue_Context *ctx, yue_Object *sym);
 YUE_DEF void yue_set(yue_Context *ctx, yue_Object *sym, yue_Object *value);
 
 // Executing file
 
-// This will read a single top object and modify the file
+// This will read a single top object and modify the file.
+// Calls to the macros defined in ctx are expanded in the object that's returned
 YUE_DEF yue_Object *yue_read(yue_Context *ctx, yue_File *file);
 
+// Error handling
+// Outside of yue_peval/yue_pread errors print the message and exit the process.
+// Inside them the evaluation is unwound back to the call, the root stack and
+// scopes are restored, and the context can be used again.
+YUE_DEF void yue_error(yue_Context *ctx, const char *fmt, ...);
+YUE_DEF yue_Status yue_peval(yue_Context *ctx, yue_Object *obj, yue_Object **result);
+YUE_DEF yue_Status yue_pread(yue_Context *ctx, yue_File *file, yue_Object **result);
+YUE_DEF const char *yue_geterror(yue_Context *ctx);
+YUE_DEF int yue_getexitcode(yue_Context *ctx);
+
+// Shared code
+// A code segment holds parsed top level forms in its own buffer. It's read-only once 
+// loaded and can be run by any number of contexts, on any thread, without copying.
+// It must stay alive as long as a context that ran it may still refer to it
+// (until the context is reset), use the reference count to track that.
+// Top level defmacro forms are run while loading, with the builtins only, and the
+// forms after them are stored expanded.
+YUE_DEF yue_Code *yue_code_open(void *buf, size_t bufsz);
+YUE_DEF yue_Status yue_code_load(yue_Code *code, yue_File *file);
+// Name of the file the code comes from, used by the profiler
+YUE_DEF void yue_code_setname(yue_Code *code, const char *name);
+YUE_DEF const char *yue_code_geterror(yue_Code *code);
+YUE_DEF void yue_code_retain(yue_Code *code);
+// Returns true when the last reference is dropped and the code can be closed
+YUE_DEF bool yue_code_release(yue_Code *code);
+// Frees what the code keeps outside of its buffer, the buffer itself is the host's
+YUE_DEF void yue_code_close(yue_Code *code);
+// Evaluates every form in order, stops at the first error
+YUE_DEF yue_Status yue_code_run(yue_Context *ctx, yue_Code *code, yue_Object **result);
+
+// Fuel
+// When fuel is set every evaluation step and loop iteration costs one unit.
+// Running out inside a task suspends it until the scheduler gives it more fuel,
+// anywhere else it raises an error. A negative fuel turns metering off (default).
+YUE_DEF void yue_setfuel(yue_Context *ctx, long fuel);
+YUE_DEF long yue_getfuel(yue_Context *ctx);
+
+// Tasks
+// A task runs a code segment in a context on its own stack, so it can be
+// suspended in the middle of evaluation and resumed later.
+// recommended bufsz is 256KB (most of it is the task's stack)
+YUE_DEF yue_Task *yue_task_open(void *buf, size_t bufsz, yue_Context *ctx, yue_Code *code);
+YUE_DEF bool yue_task_done(yue_Task *task);
+// Status of the finished task, the error is in the task's context
+YUE_DEF yue_Status yue_task_status(yue_Task *task);
+YUE_DEF yue_Context *yue_task_context(yue_Task *task);
+
+YUE_DEF void yue_sched_init(yue_Scheduler *sched, long slice);
+YUE_DEF void yue_sched_add(yue_Scheduler *sched, yue_Task *task);
+// Gives the next task one slice, returns false when there's no task left
+YUE_DEF bool yue_sched_step(yue_Scheduler *sched);
+// Runs until every task is done
+YUE_DEF void yue_sched_run(yue_Scheduler *sched);
+
+// Parallel builtins
+// pmap and preduce split a list across count worker threads (0, the default, for
+// one per core). Each worker runs in its own context that shares the caller's
+// bindings read-only, results are copied back into the caller's heap.
+YUE_DEF void yue_setworkers(yue_Context *ctx, int count);
+
+// Sequences
+// A sequence produces its elements on demand: (map fn s), (filter fn s) and (take n s)
+// wrap s lazily, (reduce fn init s) and (collect s) consume it. Lists, coroutines (what 
+// they yield) and ranges can be used as sequences, (lines path) reads a file through a
+// fixed buffer. A sequence can be consumed once.
+// Wraps a sequence implemented in C, see yue_Seq. The struct must come from malloc.
+YUE_DEF yue_Object *yue_seq(yue_Context *ctx, yue_Seq *seq);
+
+// Serialization
+// Writes obj into dst in a compact binary format and returns its size. When that's more
+// than dstsz nothing past dstsz is written, dst can be NULL to only measure. Shared 
+// structure and cycles are kept, builtins, resources, userdata and coroutines can't be written.
+YUE_DEF size_t yue_serialize(yue_Context *ctx, yue_Object *obj, void *dst, size_t dstsz);
+// Reads what yue_serialize wrote into ctx's heap
+YUE_DEF yue_Object *yue_deserialize(yue_Context *ctx, const void *src, size_t n);
+
+// Profiler
+// Instrumented profiles time every call, sampled ones record the calls in progress when 
+// a profiling timer fires (not on Windows, and one context at a time). The timer counts the
+// CPU time of the thread that started the profile, so the time spent waiting for pmap workers
+// isn't sampled. Outside of Linux the timer is process wide and samples that land on another
+// thread are counted as dropped. Frames are named
+// after the symbol a function was called with, under the file and line of their top-level 
+// form when the code is run with yue_code_run. The profile is kept until yue_profile_clear.
+typedef enum {
+    YUE_PROFILE_INSTRUMENT,
+    YUE_PROFILE_SAMPLE,
+} yue_ProfileMode;
+// Returns false when the mode isn't available
+YUE_DEF bool yue_profile_start(yue_Context *ctx, yue_ProfileMode mode);
+YUE_DEF void yue_profile_stop(yue_Context *ctx);
+YUE_DEF void yue_profile_clear(yue_Context *ctx);
+// One `frame;frame;frame count` line per call stack, as read by flamegraph tools. Counts 
+// are microseconds spent in the last frame itself, or samples
+YUE_DEF void yue_profile_folded(yue_Context *ctx, FILE *out);
+// Calls, inclusive and exclusive time (or samples) per function
+YUE_DEF void yue_profile_report(yue_Context *ctx, FILE *out);
+
+// Heap profiler
+// Tags every allocation with its site, `file:line;function;builtin`: the top-level form 
+// run by yue_code_run, the function called in it and the builtin that allocated. Each
+// collection counts the objects every site still retains. The profile is kept until 
+// yue_heap_clear. When log isn't NULL the top sites are written to it after every collection
+YUE_DEF bool yue_heap_start(yue_Context *ctx, FILE *log);
+YUE_DEF void yue_heap_stop(yue_Context *ctx);
+YUE_DEF void yue_heap_clear(yue_Context *ctx);
+// Allocations, retained and peak retained objects per site
+YUE_DEF void yue_heap_report(yue_Context *ctx, FILE *out);
+// The live objects as `site\ttype\tobjects\tbytes` lines sorted by site, two snapshots 
+// can be compared with diff
+YUE_DEF void yue_heap_snapshot(yue_Context *ctx, FILE *out);
+
+// Hardware counters
+// Linux perf_event counters of the thread running the context, counted for the whole run,
+// for every top-level form run by yue_code_run and for the collections. Counters the kernel
+// doesn't permit (see perf_event_paranoid) read as 0 and are reported as -.
+typedef enum {
+    YUE_COUNTER_CYCLES,
+    YUE_COUNTER_INSTRUCTIONS,
+    YUE_COUNTER_BRANCH_MISSES,
+    YUE_COUNTER_L1D_MISSES,
+    YUE_COUNTER_LLC_MISSES,
+    YUE_COUNTER_DTLB_MISSES,
+    YUE_COUNTER_COUNT,
+} yue_Counter;
+typedef struct {
+    uint64_t value[YUE_COUNTER_COUNT];
+} yue_CounterSet;
+// Returns false when no counter can be opened, the program runs the same without them
+YUE_DEF bool yue_counters_start(yue_Context *ctx);
+YUE_DEF void yue_counters_stop(yue_Context *ctx);
+YUE_DEF void yue_counters_clear(yue_Context *ctx);
+YUE_DEF bool yue_counters_available(yue_Context *ctx, yue_Counter counter);
+// A region of the host's own, e.g. around yue_eval: region holds what was counted 
+// between begin and end after yue_counters_end
+YUE_DEF void yue_counters_begin(yue_Context *ctx, yue_CounterSet *region);
+YUE_DEF void yue_counters_end(yue_Context *ctx, yue_CounterSet *region);
+// The run, the collections and the most expensive top-level forms
+YUE_DEF void yue_counters_report(yue_Context *ctx, FILE *out);
+
+// Tracing
+// Records compact events into a ring buffer of the context that keeps the latest 
+// YUE_TRACE_EVENTS: calls, collections, every YUE_TRACE_BURST allocations, plugin loads
+// and errors. The context is the only writer, a dump can be taken from another thread
+// while it runs. The buffer is kept until yue_trace_clear.
+typedef enum {
+    YUE_TRACE_ENTER,
+    YUE_TRACE_EXIT,
+    YUE_TRACE_GC_BEGIN,
+    YUE_TRACE_GC_END,
+    YUE_TRACE_ALLOC,
+    YUE_TRACE_PLUGIN,
+    YUE_TRACE_ERROR,
+    YUE_TRACE_MARK,
+} yue_TraceKind;
+YUE_DEF bool yue_trace_start(yue_Context *ctx);
+YUE_DEF void yue_trace_stop(yue_Context *ctx);
+YUE_DEF void yue_trace_clear(yue_Context *ctx);
+// Records an event of the host's own, name can be NULL
+YUE_DEF void yue_trace_event(yue_Context *ctx, yue_TraceKind kind, const char *name, uint64_t arg);
+// Writes the buffer in a binary format for yue_trace_json, it's only read on the same machine
+YUE_DEF bool yue_trace_save(yue_Context *ctx, FILE *out);
+// Converts a saved buffer to Chrome trace-event JSON (chrome://tracing, Perfetto)
+YUE_DEF bool yue_trace_json(FILE *in, FILE *out);
+
+// Records
+// (defrecord point x y) binds the record type `point`: (point 1 2) makes an instance,
+// (point? obj) tests for one, (point-x p) and (set-point-x p value) read and write a
+// field. Fields are stored in one block and accessors go straight to their slot.
+YUE_DEF yue_Object *yue_record_type(yue_Context *ctx, const char *name, const char **fields, size_t count);
+// An instance of type, values holds one value per field
+YUE_DEF yue_Object *yue_record(yue_Context *ctx, yue_Object *type, yue_Object **values);
+YUE_DEF bool yue_isrecord(yue_Object *obj, yue_Object *type);
+// Index of the field, resolve it once and use it with yue_record_get/yue_record_set
+YUE_DEF size_t yue_record_field(yue_Context *ctx, yue_Object *type, const char *name);
+YUE_DEF yue_Object *yue_record_get(yue_Context *ctx, yue_Object *record, size_t index);
+YUE_DEF void yue_record_set(yue_Context *ctx, yue_Object *record, size_t index, yue_Object *value);
+
 // Object accessor
 YUE_DEF bool yue_isnil(yue_Object *obj);
 YUE_DEF yue_Number yue_tonumber(yue_Context *ctx, yue_Object *obj);
@@ -96,9 +376,95 @@ YUE_DEF yue_Object *yue_symbol(yue_Context *ctx, const char *name);
 YUE_DEF yue_Object *yue_userdata(yue_Context *ctx, void *userdata);
 YUE_DEF yue_Object *yue_func(yue_Context *ctx, yue_Object *params, yue_Object *body);
 
+// Garbage collector
+// Objects created since yue_savegc are kept alive until yue_restoregc
+YUE_DEF size_t yue_savegc(yue_Context *ctx);
+YUE_DEF void yue_restoregc(yue_Context *ctx, size_t gc);
+YUE_DEF void yue_rungc(yue_Context *ctx);
+
+// Totals are counted from yue_open, yue_reset doesn't clear them
+typedef struct yue_GCStats {
+    size_t allocations;
+    size_t collections;
+    double total_pause_ms;
+    double max_pause_ms;
+    // objects kept and freed by the last collection
+    size_t marked;
+    size_t freed;
+    size_t total_freed;
+    size_t free_list;
+    // objects handed out at least once, out of count_objects
+    size_t fresh_objects;
+    size_t count_objects;
+    // deepest the root stack and the scopes have been
+    size_t stack_high_water;
+    size_t scope_high_water;
+    // reachable objects of each type
+    size_t live[YUE_OBJECT_TYPE_COUNT];
+} yue_GCStats;
+// Fills stats, the census of live objects costs a mark phase
+YUE_DEF void yue_gcstats(yue_Context *ctx, yue_GCStats *stats);
+// Writes yue_gcstats as a short summary
+YUE_DEF void yue_gcstats_report(yue_Context *ctx, FILE *f);
+
 YUE_DEF yue_Object *yue_nextarg(yue_Context *ctx, yue_Object **p_arg);
 YUE_DEF yue_Object *yue_cfunc(yue_Context *ctx, yue_CFunc cfunc);
 
+// Natives
+// A C function registered with a signature like "iis>b": a letter per argument, then the
+// result after '>'. The runtime evaluates and converts the arguments and boxes the result.
+//   i integer  f float  b boolean (nil is false)  s string  u userdata  o object
+//   v nothing, as a result
+// Strings are only valid during the call, all the strings of a call together can't be longer
+// than YUE_NATIVE_STRINGS bytes (with a terminator each). Small integers and booleans are returned without
+// allocating. natives must outlive the context, usually they're a static table.
+#ifndef YUE_NATIVE_ARGS
+#define YUE_NATIVE_ARGS 16
+#endif
+// bytes of all the string arguments of a call
+#ifndef YUE_NATIVE_STRINGS
+#define YUE_NATIVE_STRINGS 1024
+#endif
+YUE_DEF void yue_register(yue_Context *ctx, const yue_Native *natives, size_t count);
+// The shared object returned for true, nil is false
+YUE_DEF yue_Object *yue_true(yue_Context *ctx);
+
+// Plugins
+// Everything a plugin exports, usually static tables. Nothing is created when the plugin is
+// registered, an export is bound as a global the first time a script reads its name, so a
+// large table costs nothing until it's used. Registering the same plugin again does nothing.
+typedef struct {
+    const char *name;
+    yue_Number value;
+} yue_Constant;
+typedef struct {
+    const yue_Native *natives;
+    size_t count_natives;
+    const yue_Constant *constants;
+    size_t count_constants;
+} yue_Plugin;
+YUE_DEF void yue_register_plugin(yue_Context *ctx, const yue_Plugin *plugin);
+
+// Modules
+// (= geo (require "geo.yue")) makes a module, `geo/area` reads the binding `area` of the
+// module's top level. A module is parsed and evaluated the first time one of its bindings is
+// read, once per context, and is shared by every require of the same file. Its bindings
+// don't go into the global scope, its functions see them wherever they're called from.
+// Relative paths inside a module are resolved from the module's directory.
+#ifndef YUE_PATH_CAP
+#ifdef PATH_MAX
+#define YUE_PATH_CAP PATH_MAX
+#else
+#define YUE_PATH_CAP 4096
+#endif
+#endif
+
+// Batches
+// (batch) makes a command buffer of native calls. (batch-add b fn args...) converts the
+// arguments once and stores them unboxed, (batch-run b) calls every command from C and
+// (batch-clear b) empties it. Consecutive commands of a native with a batch function are
+// passed to it in one call. Results are dropped, batch-run returns the number of commands.
+
 // Builtin functions
 YUE_DEF yue_Object *yue_builtin_while(yue_Context *ctx, yue_Object *arg);
 YUE_DEF yue_Object *yue_builtin_if(yue_Context *ctx, yue_Object *arg);
@@ -109,17 +475,120 @@ YUE_DEF yue_Object *yue_builtin_dolist(yue_Context *ctx, yue_Object *arg);
 YUE_DEF yue_Object *yue_builtin_assign(yue_Context *ctx, yue_Object *arg);
 YUE_DEF yue_Object *yue_builtin_not(yue_Context *ctx, yue_Object *arg);
 YUE_DEF yue_Object *yue_builtin_exit(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_try(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_quote(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_coroutine(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_resume(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_yield(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_coroutine_done(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_pmap(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_preduce(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_serialize(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_deserialize(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_length(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_nth(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_append(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_reverse(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_assoc(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_member(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_sort(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_memo(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_memo_stats(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_batch(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_batch_add(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_batch_run(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_batch_clear(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_require(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_defrecord(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_defmacro(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_gensym(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_gc_stats(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_heap_snapshot(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_seq(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_range(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_lines(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_map(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_filter(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_take(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_reduce(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_collect(yue_Context *ctx, yue_Object *arg);
+// Makes the builtins available to ctx, each one is bound as a global the first time it's used
 YUE_DEF void yue_load_builtins(yue_Context *ctx);
 
+#if defined(__linux__)
+// Event loop
+// `spawn` starts a function as a task of the context's event loop and `run` drives
+// every task until they're all done. Reading, writing, accepting, connecting and
+// sleeping inside a task park it until its fd is ready instead of blocking the context,
+// outside of a task they block.
+YUE_DEF yue_Object *yue_builtin_spawn(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_run(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_await(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_sleep(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_pipe(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_open_file(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_fd_read(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_fd_write(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_fd_close(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_tcp_listen(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_tcp_port(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_tcp_accept(yue_Context *ctx, yue_Object *arg);
+YUE_DEF yue_Object *yue_builtin_tcp_connect(yue_Context *ctx, yue_Object *arg);
+YUE_DEF void yue_load_io(yue_Context *ctx);
+#endif
+
+// Context pool
+// Splits buf into contexts of ctxsz bytes, each with builtins loaded, setup (can be NULL) 
+// applied and its base marked. Returns how many contexts were created.
+YUE_DEF size_t yue_pool_init(yue_Pool *pool, void *buf, size_t bufsz, size_t ctxsz, void (*setup)(yue_Context *ctx));
+// Returns NULL when every context is in use
+YUE_DEF yue_Context *yue_pool_acquire(yue_Pool *pool);
+YUE_DEF void yue_pool_release(yue_Pool *pool, yue_Context *ctx);
+
 #endif // YUE_H_
 
 #ifdef YUE_IMPLEMENTATION
 #undef YUE_IMPLEMENTATION
 
 #include <assert.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(__x86_64__) || !defined(__ELF__) || defined(YUE_NO_FAST_FIBER)
+#include <ucontext.h>
+#endif
+
+#if defined(_WIN32)
+typedef HANDLE yue_Thread;
+#define YUE_THREAD_PROC DWORD WINAPI
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef pthread_t yue_Thread;
+#define YUE_THREAD_PROC void *
+#endif
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #define YUE_STRING_DATA_SIZE 32
 struct yue_Object {
@@ -129,6 +598,7 @@ struct yue_Object {
     union {
         yue_Number as_number;
         yue_CFunc  as_cfunc;
+        const yue_Native *as_native;
         struct {
             yue_Object *head;
             yue_Object *tail;
@@ -151,25 +621,283 @@ struct yue_Object {
         struct {
             yue_Object *params;
             yue_Object *body;
+            // the module the function was made in, NULL outside of modules
+            yue_Object *module;
         } as_func;
         struct {
             void *data;
             void (*destroy)(void *data);
         } as_resource;
         void *as_userdata;
+        struct yue_Coroutine *as_coroutine;
+        struct yue_Seq *as_seq;
+        struct yue_Memo *as_memo;
+        struct yue_Record *as_record;
+        struct yue_Batch *as_batch;
+        struct yue_Module *as_module;
     };
 };
 
-struct yue_Context {
-    yue_Object *stack[YUE_STACK_CAP];
+// A host boundary set up by yue_peval/yue_pread, errors jump back to the innermost one
+typedef struct yue_Jump {
+    jmp_buf buf;
+    struct yue_Jump *prev;
+    size_t stack_size;
+    size_t scope_size;
+    size_t profile_depth;
+    uint32_t heap_function;
+    uint32_t heap_builtin;
+    size_t trace_depth;
+    yue_Object *module;
+    size_t module_scope;
+} yue_Jump;
+
+// Fibers are the separate stacks tasks and coroutines run on. On x86-64 ELF targets
+// switching is done by hand (only callee saved registers, no signal mask syscall),
+// everywhere else it falls back to ucontext or Windows fibers.
+#if defined(__x86_64__) && defined(__ELF__) && !defined(YUE_NO_FAST_FIBER)
+#define YUE_FAST_FIBER
+#endif
+
+typedef struct yue_Fiber {
+    void (*entry)(void *arg);
+    void *arg;
+#if defined(YUE_FAST_FIBER)
+    void *sp;
+#elif defined(_WIN32)
+    LPVOID handle;
+#else
+    ucontext_t uc;
+#endif
+} yue_Fiber;
+
+#if defined(YUE_FAST_FIBER)
+// _yue_fiber_swap(void **from_sp, void **to_sp)
+__asm__(
+    ".text\n"
+    ".type _yue_fiber_swap, @function\n"
+    "_yue_fiber_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq (%rsi), %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size _yue_fiber_swap, .-_yue_fiber_swap\n"
+    // first switch into a fiber lands here with entry in r12 and arg in r13
+    ".type _yue_fiber_start, @function\n"
+    "_yue_fiber_start:\n"
+    "    movq %r13, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size _yue_fiber_start, .-_yue_fiber_start\n"
+);
+void _yue_fiber_swap(void **from_sp, void **to_sp) __asm__("_yue_fiber_swap");
+void _yue_fiber_start(void) __asm__("_yue_fiber_start");
+#elif defined(_WIN32)
+static VOID CALLBACK _yue_fiber_entry(LPVOID param)
+{
+    yue_Fiber *fiber = param;
+    fiber->entry(fiber->arg);
+}
+#else
+static void _yue_fiber_entry(unsigned int hi, unsigned int lo)
+{
+    yue_Fiber *fiber = (yue_Fiber*)(((uintptr_t)hi << 16 << 16) | (uintptr_t)lo);
+    fiber->entry(fiber->arg);
+}
+#endif
+
+// entry must never return, switch away from it instead
+static bool _yue_fiber_init(yue_Fiber *fiber, void *stack, size_t stacksz, void (*entry)(void *arg), void *arg)
+{
+    fiber->entry = entry;
+    fiber->arg   = arg;
+#if defined(YUE_FAST_FIBER)
+    uintptr_t top = ((uintptr_t)stack + stacksz) & ~(uintptr_t)15;
+    // r15, r14, r13, r12, rbx, rbp, return address, then 16 byte alignment for the call
+    void **sp = (void**)(top - 16 - 7 * sizeof(void*));
+    memset(sp, 0, 7 * sizeof(void*));
+    void (*start)(void) = _yue_fiber_start;
+    sp[2] = arg;
+    memcpy(&sp[3], &entry, sizeof(void*));
+    memcpy(&sp[6], &start, sizeof(void*));
+    fiber->sp = sp;
+    return true;
+#elif defined(_WIN32)
+    (void)stack;
+    fiber->handle = CreateFiber(stacksz, _yue_fiber_entry, fiber);
+    return fiber->handle != NULL;
+#else
+    if(getcontext(&fiber->uc) < 0) return false;
+    fiber->uc.uc_stack.ss_sp   = stack;
+    fiber->uc.uc_stack.ss_size = stacksz;
+    fiber->uc.uc_link          = NULL;
+    uintptr_t p = (uintptr_t)fiber;
+    makecontext(&fiber->uc, (void (*)(void))_yue_fiber_entry, 2, 
+            (unsigned int)(p >> 16 >> 16), (unsigned int)(p & 0xffffffffu));
+    return true;
+#endif
+}
+
+// Saves the running context into from and continues to
+static void _yue_fiber_switch(yue_Fiber *from, yue_Fiber *to)
+{
+#if defined(YUE_FAST_FIBER)
+    _yue_fiber_swap(&from->sp, &to->sp);
+#elif defined(_WIN32)
+    if(!IsThreadAFiber()) ConvertThreadToFiber(NULL);
+    from->handle = GetCurrentFiber();
+    SwitchToFiber(to->handle);
+#else
+    swapcontext(&from->uc, &to->uc);
+#endif
+}
+
+struct yue_Code {
+    atomic_size_t refs;
+    // the forms live in this context's heap, it is never used to evaluate anything
+    yue_Context *ctx;
+    // (nil . forms), always on ctx's root stack
+    yue_Object *forms;
+    yue_Object *last;
+    // line of each form, in the same order
+    size_t *lines;
+    size_t count_lines;
+    size_t cap_lines;
+    char name[256];
+};
+
+#ifndef YUE_COROUTINE_STACK
+#define YUE_COROUTINE_STACK (64 * 1024)
+#endif
+
+typedef enum {
+    YUE_COROUTINE_SUSPENDED,
+    YUE_COROUTINE_RUNNING,
+    YUE_COROUTINE_DEAD,
+} yue_CoroutineState;
+
+// Everything that's swapped when switching between coroutines
+typedef struct yue_Frame {
+    yue_Object **stack;
     size_t stack_size;
+    yue_Object **scope;
+    size_t scope_size;
+    yue_Jump *jump;
+    struct yue_Coroutine *coroutine;
+    yue_Object *module;
+    size_t module_scope;
+} yue_Frame;
+
+typedef struct yue_Coroutine {
+    yue_Context *ctx;
+    yue_Fiber fiber;
+    yue_Fiber caller;
+    yue_CoroutineState state;
+    bool started;
+    // made before yue_markbase, what it keeps after the base is recycled by yue_reset
+    bool before_base;
+    // status of a dead coroutine
+    yue_Status status;
+    // 1 + its slot in the event loop for coroutines started by `spawn`, 0 otherwise
+    size_t io_slot;
+    yue_Object *fn;
+    // arguments of the first resume, then whatever is passed by resume/yield/return
+    yue_Object *value;
+    // the coroutine's own frame while it's suspended, 
+    // the resumer's frame while it's running
+    yue_Frame frame;
+    yue_Object *stack[YUE_STACK_CAP];
     yue_Object *scope[YUE_MAX_SCOPE_DEPTH];
+    char cstack[];
+} yue_Coroutine;
+
+#ifndef YUE_LINE_CAP
+#define YUE_LINE_CAP 4096
+#endif
+
+struct yue_Context {
+    // these point into the running coroutine, or stack_base/scope_base outside of one
+    yue_Object **stack;
+    size_t stack_size;
+    yue_Object **scope;
     size_t scope_size;
     yue_Object *nil;
+    // shared like nil, yue_number returns these for small integers
+    yue_Object numbers[YUE_SMALL_INTS];
 
     yue_Object *free_list;
     yue_Object *objects;
     size_t count_objects;
+    // objects[0..fresh_objects] have been handed out at least once, 
+    // the rest is still untouched and is allocated by bumping this
+    size_t fresh_objects;
+
+    // what yue_reset goes back to, see yue_markbase
+    struct {
+        // list of (symbol . value) for every global at the time of marking
+        yue_Object *bindings;
+        // list of (object . copy) for the records, memos and batches live at the time of marking
+        yue_Object *snapshots;
+        yue_Object *globals;
+        yue_Object *modules;
+        yue_Object *plugins;
+        size_t stack_size;
+        size_t fresh_objects;
+    } base;
+
+    yue_Jump *jump;
+    char error[YUE_ERROR_CAP];
+    int exit_code;
+
+    bool metered;
+    long fuel;
+    // what's left of the fuel of the pmap call this context is a worker of, see _yue_fuel_refill
+    atomic_long *fuel_pool;
+    // the task this context is currently running in
+    yue_Task *task;
+    yue_Coroutine *coroutine;
+    // created by the first `spawn`
+    struct yue_Loop *loop;
+    // threads used by pmap and preduce, 0 for one per core
+    int workers;
+    // reading expands macro calls once any macro is defined
+    size_t count_macros;
+    size_t count_gensyms;
+    // counters of yue_gcstats, the census and the heap's state are filled when it's called
+    yue_GCStats gc;
+    // set by yue_profile_start
+    yue_Profile *profile;
+    // set by yue_heap_start
+    yue_HeapProfile *heap_profile;
+    // set by yue_counters_start
+    yue_Counters *counters;
+    // set by yue_trace_start
+    yue_Trace *trace;
+    // the module whose code is running and the scope holding its bindings, `=` doesn't
+    // reach below that scope
+    yue_Object *module;
+    size_t module_scope;
+    // every module required so far, linked by yue_Module.next
+    yue_Object *modules;
+    // list of userdata pointing to the registered yue_Plugin, see _yue_plugin_get
+    yue_Object *plugins;
+    // set by yue_load_builtins and yue_load_io, see _yue_builtin_get
+    bool builtins;
+    bool io;
+
+    yue_Object *stack_base[YUE_STACK_CAP];
+    yue_Object *scope_base[YUE_MAX_SCOPE_DEPTH];
 };
 
 static const char *_yue_type_names[] = {
@@ -182,25 +910,330 @@ static const char *_yue_type_names[] = {
     [YUE_OBJECT_FUNC] = "YUE_OBJECT_FUNC",
     [YUE_OBJECT_CFUNC] = "YUE_OBJECT_CFUNC",
     [YUE_OBJECT_RESOURCE] = "YUE_OBJECT_RESOURCE",
+    [YUE_OBJECT_COROUTINE] = "YUE_OBJECT_COROUTINE",
+    [YUE_OBJECT_SEQ] = "YUE_OBJECT_SEQ",
+    [YUE_OBJECT_MEMO] = "YUE_OBJECT_MEMO",
+    [YUE_OBJECT_RECORD] = "YUE_OBJECT_RECORD",
+    [YUE_OBJECT_MACRO] = "YUE_OBJECT_MACRO",
+    [YUE_OBJECT_NATIVE] = "YUE_OBJECT_NATIVE",
+    [YUE_OBJECT_BATCH] = "YUE_OBJECT_BATCH",
+    [YUE_OBJECT_MODULE] = "YUE_OBJECT_MODULE",
+};
+
+typedef enum {
+    YUE_RECORD_INSTANCE,
+    YUE_RECORD_TYPE,
+    YUE_RECORD_PREDICATE,
+    YUE_RECORD_GETTER,
+    YUE_RECORD_SETTER,
+} yue_RecordKind;
+
+// Types and their accessors are records as well, so that they can be called
+typedef struct yue_Record {
+    yue_RecordKind kind;
+    // the record type of instances and accessors, the name of types
+    yue_Object *type;
+    // the slot read or written by an accessor
+    size_t index;
+    // field values of instances, field names of types
+    size_t count;
+    yue_Object *slots[];
+} yue_Record;
+
+// A builtin bound as a global when it's first looked up, fn lives outside of every heap
+typedef struct {
+    const char *name;
+    yue_Object fn;
+} yue_Builtin;
+
+#ifndef YUE_PROFILE_DEPTH
+#define YUE_PROFILE_DEPTH 256
+#endif
+
+// size of the sample buffer in frames, samples that don't fit are dropped
+#ifndef YUE_PROFILE_SAMPLES
+#define YUE_PROFILE_SAMPLES (1 << 20)
+#endif
+
+// sampling period in microseconds
+#ifndef YUE_PROFILE_PERIOD
+#define YUE_PROFILE_PERIOD 1000
+#endif
+
+#define YUE_PROFILE_NAME 128
+#define YUE_PROFILE_NONE UINT32_MAX
+
+// Interned names of the profiler, the heap profiler and the hardware counters. Ids are
+// handed out in order from 0 and a name doesn't move once it's interned
+typedef struct {
+    char **names;
+    uint32_t count_names;
+    uint32_t cap_names;
+    // open addressing into names, kept at most half full
+    uint32_t *slots;
+    uint32_t count_slots;
+} yue_Names;
+
+// A node of the call tree, node 0 is the root that every top-level form hangs from
+typedef struct {
+    uint32_t parent;
+    uint32_t name;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t self_ns;
+    uint64_t samples;
+} yue_ProfileNode;
+
+typedef struct {
+    uint32_t name;
+    uint32_t node;
+    uint64_t start_ns;
+    uint64_t child_ns;
+} yue_ProfileFrame;
+
+struct yue_Profile {
+    yue_ProfileMode mode;
+    bool running;
+
+    // frame names
+    yue_Names names;
+
+    yue_ProfileNode *nodes;
+    uint32_t count_nodes;
+    uint32_t cap_nodes;
+
+    // what's being called right now, read by the signal handler when sampling
+    yue_ProfileFrame stack[YUE_PROFILE_DEPTH];
+    volatile size_t depth;
+    // calls deeper than the stack, they're not recorded
+    size_t overflow;
+
+    // every sample is its depth followed by the names of its frames
+    uint32_t *samples;
+    volatile size_t count_samples;
+    size_t folded_samples;
+    size_t dropped;
+#if defined(__linux__)
+    // CPU time of the sampling thread, see yue_profile_start
+    timer_t timer;
+#endif
+};
+
+#define YUE_HEAP_SITE_NAME 160
+// sites written to the log after a collection
+#ifndef YUE_HEAP_REPORT_TOP
+#define YUE_HEAP_REPORT_TOP 10
+#endif
+
+// Sites and the parts of their names are interned in the same table
+typedef struct {
+    // in the names of the profile, at the same index as the site
+    const char *name;
+    uint64_t allocations;
+    // allocated since the last collection
+    uint64_t recent;
+    // kept by the last collection
+    uint64_t retained;
+    uint64_t peak_retained;
+} yue_HeapSite;
+
+struct yue_HeapProfile {
+    bool running;
+    FILE *log;
+
+    yue_Names names;
+    // one per name
+    yue_HeapSite *sites;
+    uint32_t count_sites;
+    uint32_t cap_sites;
+    // the site every object of the heap was allocated from
+    uint32_t *tags;
+
+    // where allocations come from right now, site is YUE_PROFILE_NONE until it's named
+    uint32_t location;
+    uint32_t function;
+    uint32_t builtin;
+    uint32_t site;
+
+    size_t collections;
+    uint64_t last_ns;
+};
+
+// forms written by yue_counters_report
+#ifndef YUE_COUNTER_REPORT_TOP
+#define YUE_COUNTER_REPORT_TOP 20
+#endif
+
+typedef struct {
+    // in the names of the counters, at the same index as the form
+    const char *name;
+    uint64_t runs;
+    yue_CounterSet counted;
+} yue_CounterForm;
+
+struct yue_Counters {
+    bool running;
+    // -1 for counters that couldn't be opened
+    int fds[YUE_COUNTER_COUNT];
+    // read when started, run adds up every start to stop
+    yue_CounterSet start;
+    uint64_t start_ns;
+    yue_CounterSet run;
+    uint64_t run_ns;
+
+    yue_CounterSet gc;
+    size_t collections;
+
+    yue_Names names;
+    // one per name
+    yue_CounterForm *forms;
+    uint32_t count_forms;
+    uint32_t cap_forms;
+};
+
+// events kept by the ring buffer, a power of two
+#ifndef YUE_TRACE_EVENTS
+#define YUE_TRACE_EVENTS (1 << 16)
+#endif
+
+// allocations between two YUE_TRACE_ALLOC events, a power of two
+#ifndef YUE_TRACE_BURST
+#define YUE_TRACE_BURST 1024
+#endif
+
+#define YUE_TRACE_NAMES 4096
+#define YUE_TRACE_NAME 48
+
+typedef struct {
+    // since yue_trace_start
+    uint64_t ns;
+    uint32_t name;
+    uint32_t kind;
+    uint64_t arg;
+} yue_TraceEvent;
+
+// Names are never moved and events are published by advancing head, so a reader
+// only sees complete ones
+struct yue_Trace {
+    bool running;
+    uint64_t start_ns;
+    // calls entered and not exited
+    size_t depth;
+    atomic_size_t head;
+    _Atomic uint32_t count_names;
+    uint32_t slots[YUE_TRACE_NAMES * 2];
+    char names[YUE_TRACE_NAMES][YUE_TRACE_NAME];
+    yue_TraceEvent events[YUE_TRACE_EVENTS];
 };
 
+static inline bool _yue_callable(yue_Object *obj)
+{
+    return obj->type == YUE_OBJECT_FUNC || obj->type == YUE_OBJECT_CFUNC || obj->type == YUE_OBJECT_MEMO || obj->type == YUE_OBJECT_NATIVE ||
+        (obj->type == YUE_OBJECT_RECORD && obj->as_record->kind != YUE_RECORD_INSTANCE);
+}
+
+
+static void _yue_throw(yue_Context *ctx, yue_Status status)
+{
+    if(ctx->jump) longjmp(ctx->jump->buf, status);
+    if(status == YUE_EXIT) exit(ctx->exit_code);
+    fprintf(stderr, "ERROR: %s\n", ctx->error);
+    exit(EXIT_FAILURE);
+}
 
 void yue_error(yue_Context *ctx, const char *fmt, ...)
 {
-    (void)ctx;
-    fprintf(stderr, "ERROR: ");
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vsnprintf(ctx->error, sizeof(ctx->error), fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
-    exit(EXIT_FAILURE);
+    size_t len = strlen(ctx->error);
+    while(len > 0 && ctx->error[len - 1] == '\n') ctx->error[--len] = 0;
+    if(ctx->trace && ctx->trace->running) yue_trace_event(ctx, YUE_TRACE_ERROR, ctx->error, 0);
+    _yue_throw(ctx, YUE_ERROR);
+}
+
+typedef yue_Object *(*_yue_ProtectedFn)(yue_Context *ctx, void *arg);
+
+static void _yue_profile_unwind(yue_Profile *prof, size_t depth);
+static void _yue_trace_unwind(yue_Trace *trace, size_t depth);
+
+static yue_Status _yue_protect(yue_Context *ctx, _yue_ProtectedFn fn, void *arg, yue_Object **result)
+{
+    yue_Jump jump;
+    jump.prev       = ctx->jump;
+    jump.stack_size = ctx->stack_size;
+    jump.scope_size = ctx->scope_size;
+    jump.profile_depth = ctx->profile ? ctx->profile->depth : 0;
+    jump.heap_function = ctx->heap_profile ? ctx->heap_profile->function : YUE_PROFILE_NONE;
+    jump.heap_builtin  = ctx->heap_profile ? ctx->heap_profile->builtin : YUE_PROFILE_NONE;
+    jump.trace_depth   = ctx->trace ? ctx->trace->depth : 0;
+    jump.module        = ctx->module;
+    jump.module_scope  = ctx->module_scope;
+    ctx->jump = &jump;
+    int status = setjmp(jump.buf);
+    if(status == YUE_OK) {
+        yue_Object *res = fn(ctx, arg);
+        ctx->jump = jump.prev;
+        if(result) *result = res;
+        return YUE_OK;
+    }
+    ctx->jump = jump.prev;
+    while(ctx->scope_size > jump.scope_size) {
+        ctx->scope_size -= 1;
+        ctx->scope[ctx->scope_size] = NULL;
+    }
+    ctx->stack_size   = jump.stack_size;
+    ctx->module       = jump.module;
+    ctx->module_scope = jump.module_scope;
+    if(ctx->profile && ctx->profile->running) _yue_profile_unwind(ctx->profile, jump.profile_depth);
+    if(ctx->trace && ctx->trace->running) _yue_trace_unwind(ctx->trace, jump.trace_depth);
+    if(ctx->heap_profile) {
+        ctx->heap_profile->function = jump.heap_function;
+        ctx->heap_profile->builtin  = jump.heap_builtin;
+        ctx->heap_profile->site     = YUE_PROFILE_NONE;
+    }
+    if(result) *result = ctx->nil;
+    return (yue_Status)status;
+}
+
+static yue_Object *_yue_protected_eval(yue_Context *ctx, void *arg)
+{
+    return yue_eval(ctx, arg);
+}
+
+static yue_Object *_yue_protected_read(yue_Context *ctx, void *arg)
+{
+    return yue_read(ctx, arg);
+}
+
+yue_Status yue_peval(yue_Context *ctx, yue_Object *obj, yue_Object **result)
+{
+    return _yue_protect(ctx, _yue_protected_eval, obj, result);
+}
+
+yue_Status yue_pread(yue_Context *ctx, yue_File *file, yue_Object **result)
+{
+    return _yue_protect(ctx, _yue_protected_read, file, result);
+}
+
+const char *yue_geterror(yue_Context *ctx)
+{
+    return ctx->error;
+}
+
+int yue_getexitcode(yue_Context *ctx)
+{
+    return ctx->exit_code;
 }
 
 yue_Context *yue_open(void *buf, size_t bufsz)
 {
     yue_Context *ctx;
-    memset(buf, 0, bufsz);
+    // only the header is cleared, objects are initialized when they're first handed out
+    memset(buf, 0, sizeof(*ctx) + sizeof(yue_Object));
     ctx    = buf;
     buf    = (char*)buf + sizeof(*ctx);
     bufsz -= sizeof(*ctx);
@@ -208,49 +1241,135 @@ yue_Context *yue_open(void *buf, size_t bufsz)
     yue_Object *nil = buf;
     nil->type = YUE_OBJECT_NIL;
     ctx->nil  = nil;
+    for(int i = 0; i < YUE_SMALL_INTS; ++i) {
+        ctx->numbers[i].type      = YUE_OBJECT_NUMBER;
+        ctx->numbers[i].as_number = i;
+    }
     buf    = (char*)buf + sizeof(*nil);
     bufsz -= sizeof(*nil);
 
+    ctx->stack         = ctx->stack_base;
+    ctx->scope         = ctx->scope_base;
     ctx->scope_size    = 1; // global scope
     ctx->objects       = (yue_Object*)buf;
     ctx->count_objects = bufsz / sizeof(*ctx->objects);
-
-    for(size_t i = 0; i < ctx->count_objects; ++i) {
-        yue_Object *obj = &ctx->objects[i];
-        obj->next = NULL;
-        if(ctx->free_list == NULL) {
-            ctx->free_list = obj;
-        } else {
-            obj->next = ctx->free_list;
-            ctx->free_list = obj;
-        }
-    }
+    ctx->fresh_objects = 0;
+    ctx->free_list     = NULL;
     return ctx;
 }
 
 static void dump_obj(yue_Object *obj, int level);
+static void yue_pushgc(yue_Context *ctx, yue_Object *obj);
+static yue_Object *new_object(yue_Context *ctx, yue_ObjectType type);
+
+// Evaluates every item into a new list, the code itself is never modified
+// since it may be shared with other contexts (see yue_Code)
 static yue_Object *_eval_list(yue_Context *ctx, yue_Object *obj)
 {
     switch(obj->type) {
     case YUE_OBJECT_PAIR:
         {
-            yue_Object *base = obj;
-            while(!yue_isnil(obj)) {
-                obj->as_pair.head = yue_eval(ctx, obj->as_pair.head);
+            size_t gc = yue_savegc(ctx);
+            yue_Object *root = NULL;
+            yue_Object *prev = NULL;
+            while(obj->type == YUE_OBJECT_PAIR) {
+                yue_Object *value = yue_eval(ctx, obj->as_pair.head);
+                yue_pushgc(ctx, value);
+                yue_Object *curr = yue_pair(ctx, value, yue_nil(ctx));
+                if(prev) {
+                    prev->as_pair.tail = curr;
+                } else {
+                    root = curr;
+                }
+                prev = curr;
                 obj = obj->as_pair.tail;
+                // everything so far is reachable from root
+                yue_restoregc(ctx, gc);
+                yue_pushgc(ctx, root);
             }
-            return base;
+            yue_restoregc(ctx, gc);
+            yue_pushgc(ctx, root);
+            return root;
         } break;
     default:
         return yue_eval(ctx, obj);
     }
 }
 
+// Adds a new binding to the innermost scope. The binding is a copy of sym,
+// so the same symbol object can be bound in many scopes (and contexts) at once
+static void _yue_bind(yue_Context *ctx, yue_Object *sym, yue_Object *value)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_pushgc(ctx, value);
+    yue_Object *binding = new_object(ctx, YUE_OBJECT_SYMBOL);
+    memcpy(binding->as_symbol.name, sym->as_symbol.name, YUE_STRING_DATA_SIZE);
+    binding->as_symbol.value = value;
+    binding->next = ctx->scope[ctx->scope_size - 1];
+    ctx->scope[ctx->scope_size - 1] = binding;
+    yue_restoregc(ctx, gc);
+}
+
+static void _yue_task_yield(yue_Task *task);
+
+#ifndef YUE_FUEL_CHUNK
+#define YUE_FUEL_CHUNK 1024
+#endif
+
+// pmap workers take their fuel from the caller's in chunks, a worker that gets more
+// of the items gets more of the fuel as well
+static bool _yue_fuel_refill(yue_Context *ctx)
+{
+    long left = atomic_load(ctx->fuel_pool);
+    long take;
+    do {
+        if(left <= 0) return false;
+        take = left < YUE_FUEL_CHUNK ? left : YUE_FUEL_CHUNK;
+    } while(!atomic_compare_exchange_weak(ctx->fuel_pool, &left, left - take));
+    // this step is paid out of it
+    ctx->fuel = take - 1;
+    return true;
+}
+
+static void _yue_outoffuel(yue_Context *ctx)
+{
+    if(ctx->fuel_pool && _yue_fuel_refill(ctx)) return;
+    if(ctx->task) {
+        // the scheduler refuels us before resuming
+        _yue_task_yield(ctx->task);
+    } else {
+        ctx->fuel = 0;
+        yue_error(ctx, "Out of fuel");
+    }
+}
+
+static inline void _yue_charge(yue_Context *ctx)
+{
+    if(!ctx->metered) return;
+    if(ctx->fuel > 0) {
+        ctx->fuel -= 1;
+        return;
+    }
+    _yue_outoffuel(ctx);
+}
+
+void yue_setfuel(yue_Context *ctx, long fuel)
+{
+    ctx->metered = fuel >= 0;
+    ctx->fuel    = fuel;
+}
+
+long yue_getfuel(yue_Context *ctx)
+{
+    return ctx->metered ? ctx->fuel : -1;
+}
+
 static void begin_scope(yue_Context *ctx)
 {
-    if(ctx->scope_size > YUE_MAX_SCOPE_DEPTH) yue_error(ctx, "Max scope depth exceeded");
+    if(ctx->scope_size >= YUE_MAX_SCOPE_DEPTH) yue_error(ctx, "Max scope depth exceeded");
     ctx->scope[ctx->scope_size] = NULL;
     ctx->scope_size += 1;
+    if(ctx->scope_size > ctx->gc.scope_high_water) ctx->gc.scope_high_water = ctx->scope_size;
 }
 
 static void end_scope(yue_Context *ctx)
@@ -260,6 +1379,141 @@ static void end_scope(yue_Context *ctx)
     ctx->scope[ctx->scope_size] = NULL;
 }
 
+typedef enum {
+    YUE_MODULE_UNLOADED,
+    YUE_MODULE_LOADING,
+    YUE_MODULE_LOADED,
+} yue_ModuleState;
+
+typedef struct yue_Module {
+    // the next module required by the context
+    yue_Object *next;
+    // the module's top-level bindings, linked like a scope
+    yue_Object *bindings;
+    yue_ModuleState state;
+    // canonical, modules are found by it
+    char path[];
+} yue_Module;
+
+// The bindings of a module are a scope below the ones of its functions
+static void _yue_module_enter(yue_Context *ctx, yue_Object *module)
+{
+    ctx->module       = module;
+    ctx->module_scope = 0;
+    if(!module) return;
+    begin_scope(ctx);
+    ctx->module_scope = ctx->scope_size - 1;
+    ctx->scope[ctx->module_scope] = module->as_module->bindings;
+}
+
+// Calls a function with already evaluated arguments
+static yue_Object *_yue_invoke(yue_Context *ctx, yue_Object *fn, yue_Object *args)
+{
+    yue_Object *symbols = fn->as_func.params;
+    yue_Object *module  = ctx->module;
+    size_t module_scope = ctx->module_scope;
+    bool entered = fn->as_func.module != module;
+    if(entered) _yue_module_enter(ctx, fn->as_func.module);
+    // load arguments, missing ones are nil
+    begin_scope(ctx);
+    while(symbols->type == YUE_OBJECT_PAIR) {
+        yue_Object *symbol= symbols->as_pair.head;
+        symbols = symbols->as_pair.tail;
+        if(symbol->type != YUE_OBJECT_SYMBOL) 
+            yue_error(ctx, "Function parameter is not a symbol but %s", 
+                    _yue_type_names[symbol->type]);
+        _yue_bind(ctx, symbol, yue_nextarg(ctx, &args));
+    }
+    yue_Object *obj = yue_eval(ctx, fn->as_func.body);
+    end_scope(ctx);
+    if(entered) {
+        if(ctx->module) end_scope(ctx);
+        ctx->module       = module;
+        ctx->module_scope = module_scope;
+    }
+    return obj;
+}
+
+typedef struct yue_Memo yue_Memo;
+static void _yue_memo_mark(yue_Context *ctx, yue_Memo *memo);
+static void _yue_memo_free(yue_Memo *memo);
+static yue_Object *_yue_memo_call(yue_Context *ctx, yue_Object *obj, yue_Object *args);
+static void _yue_record_mark(yue_Context *ctx, yue_Record *record);
+static yue_Object *_yue_record_call(yue_Context *ctx, yue_Object *fn, yue_Object *args, bool eval);
+static yue_Object *_yue_native_call(yue_Context *ctx, yue_Object *fn, yue_Object *args, bool eval);
+static yue_Object *_yue_native(yue_Context *ctx, const yue_Native *native);
+static void _yue_module_mark(yue_Context *ctx, yue_Module *module);
+static yue_Object *_yue_module_get(yue_Context *ctx, const char *name);
+static yue_Object *_yue_plugin_get(yue_Context *ctx, const char *name);
+static yue_Object *_yue_builtin_get(yue_Context *ctx, const char *name);
+typedef struct yue_Batch yue_Batch;
+static void _yue_batch_mark(yue_Context *ctx, yue_Batch *batch);
+static void _yue_batch_free(yue_Batch *batch);
+static yue_Object *_yue_macro_replace(yue_Context *ctx, yue_Object *form, yue_Object *macro);
+static yue_Object *_yue_profile_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg);
+static yue_Object *_yue_heap_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg);
+static yue_Object *_yue_trace_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg);
+static void _yue_heap_tag(yue_Context *ctx, yue_Object *obj);
+static void _yue_heap_collected(yue_HeapProfile *heap);
+static void _yue_counters_add(yue_CounterSet *dst, const yue_CounterSet *src);
+
+// Calls fn with the arguments of form, unevaluated
+static inline yue_Object *_yue_apply(yue_Context *ctx, yue_Object *obj, yue_Object *base, yue_Object *fn, yue_Object *arg)
+{
+        switch(fn->type) {
+        case YUE_OBJECT_FUNC:
+            {
+                // evaluate all args first
+                size_t gc = yue_savegc(ctx);
+                arg = _eval_list(ctx, arg);
+                yue_Object *obj = _yue_invoke(ctx, fn, arg);
+                yue_restoregc(ctx, gc);
+                yue_pushgc(ctx, obj);
+                return obj;
+            }
+        case YUE_OBJECT_CFUNC:
+            return fn->as_cfunc(ctx, arg);
+        case YUE_OBJECT_MEMO:
+            {
+                size_t gc = yue_savegc(ctx);
+                arg = _eval_list(ctx, arg);
+                yue_Object *obj = _yue_memo_call(ctx, fn, arg);
+                yue_restoregc(ctx, gc);
+                yue_pushgc(ctx, obj);
+                return obj;
+            }
+        case YUE_OBJECT_RECORD:
+            return _yue_record_call(ctx, fn, arg, true);
+        case YUE_OBJECT_NATIVE:
+            return _yue_native_call(ctx, fn, arg, true);
+        case YUE_OBJECT_MACRO:
+            return yue_eval(ctx, _yue_macro_replace(ctx, obj, fn));
+        default:
+            if(base->type == YUE_OBJECT_SYMBOL) {
+                yue_error(ctx, "Invoking non callable object `%s` %s", base->as_symbol.name, _yue_type_names[fn->type]);
+            } else {
+                yue_error(ctx, "Invoking non callable object %s", _yue_type_names[fn->type]);
+            }
+            return obj;
+        }
+}
+
+// The tracer, the heap profiler and the profiler wrap a call in that order, each one
+// goes on with the hooks after its own
+typedef enum {
+    YUE_HOOK_TRACE,
+    YUE_HOOK_HEAP,
+    YUE_HOOK_PROFILE,
+} yue_Hook;
+
+static yue_Object *_yue_hooked_apply(yue_Context *ctx, yue_Hook hook, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg)
+{
+    if(hook <= YUE_HOOK_TRACE && ctx->trace && ctx->trace->running) return _yue_trace_apply(ctx, form, base, fn, arg);
+    if(hook <= YUE_HOOK_HEAP && ctx->heap_profile && ctx->heap_profile->running) return _yue_heap_apply(ctx, form, base, fn, arg);
+    if(ctx->profile && ctx->profile->running) return _yue_profile_apply(ctx, form, base, fn, arg);
+    return _yue_apply(ctx, form, base, fn, arg);
+}
+
 yue_Object *yue_eval(yue_Context *ctx, yue_Object *obj)
 {
     switch(obj->type) {
@@ -270,47 +1524,25 @@ yue_Object *yue_eval(yue_Context *ctx, yue_Object *obj)
         case YUE_OBJECT_USERDATA:
         case YUE_OBJECT_RESOURCE:
         case YUE_OBJECT_FUNC:
+        case YUE_OBJECT_COROUTINE:
+        case YUE_OBJECT_SEQ:
+        case YUE_OBJECT_MEMO:
+        case YUE_OBJECT_RECORD:
+        case YUE_OBJECT_MACRO:
+        case YUE_OBJECT_NATIVE:
+        case YUE_OBJECT_BATCH:
+        case YUE_OBJECT_MODULE:
             return obj;
         case YUE_OBJECT_SYMBOL:
             return yue_get(ctx, obj);
         case YUE_OBJECT_PAIR:
             {
+                _yue_charge(ctx);
                 yue_Object *base = obj->as_pair.head;
                 yue_Object *arg = obj->as_pair.tail;
                 yue_Object *fn = yue_eval(ctx, base);
-                switch(fn->type) {
-                case YUE_OBJECT_FUNC:
-                    {
-                        // evaluate all args first
-                        arg = _eval_list(ctx, arg);
-                        
-                        yue_Object *symbols = fn->as_func.params;
-                        // load arguments
-                        yue_Object *a = NULL;
-                        begin_scope(ctx);
-                        while(true) {
-                            if(yue_isnil((a = yue_nextarg(ctx, &arg)))) break;
-                            if(yue_isnil(symbols)) break;
-                            yue_Object *symbol= symbols->as_pair.head;
-                            if(symbol->type != YUE_OBJECT_SYMBOL) 
-                                yue_error(ctx, "Function parameter is not a symbol but %s", 
-                                        _yue_type_names[symbol->type]);
-                            yue_set(ctx, symbol, yue_eval(ctx, a));
-                        }
-                        yue_Object *obj = yue_eval(ctx, fn->as_func.body);
-                        end_scope(ctx);
-                        return obj;
-                    }
-                case YUE_OBJECT_CFUNC:
-                    return fn->as_cfunc(ctx, arg);
-                default:
-                    if(base->type == YUE_OBJECT_SYMBOL) {
-                        yue_error(ctx, "Invoking non callable object `%s` %s", base->as_symbol.name, _yue_type_names[fn->type]);
-                    } else {
-                        yue_error(ctx, "Invoking non callable object %s", _yue_type_names[fn->type]);
-                    }
-                    return obj;
-                }
+                if(ctx->trace || ctx->heap_profile || ctx->profile) return _yue_hooked_apply(ctx, YUE_HOOK_TRACE, obj, base, fn, arg);
+                return _yue_apply(ctx, obj, base, fn, arg);
             } break;
         default:
             return obj;
@@ -318,33 +1550,70 @@ yue_Object *yue_eval(yue_Context *ctx, yue_Object *obj)
     return obj;
 }
 
+static bool _yue_owns(yue_Context *ctx, yue_Object *obj)
+{
+    return ctx->objects <= obj && obj < ctx->objects + ctx->count_objects;
+}
+
 static void mark(yue_Context *ctx, yue_Object *obj)
 {
     assert(obj && "Invalid object");
-    if(obj->marked) return;
+    // the last field is followed by this loop instead of recursing, so that
+    // long lists and strings don't overflow the C stack
+    while(obj) {
+        // objects outside of the heap (nil, shared code) are never collected and 
+        // never point back into this heap, they're kept alive by their owner
+        if(!_yue_owns(ctx, obj)) return;
+        if(obj->marked) return;
 
-    obj->marked = true;
-    if(obj->type == YUE_OBJECT_PAIR) {
-        mark(ctx, obj->as_pair.head);
-        mark(ctx, obj->as_pair.tail);
-    } else if(obj->type == YUE_OBJECT_STRING) {
-        yue_Object *tail = obj->as_str.tail;
-        if(tail) mark(ctx, tail);
-    } else if(obj->type == YUE_OBJECT_FUNC) {
-        mark(ctx, obj->as_func.params);
-        mark(ctx, obj->as_func.body);
-    } else if(obj->type == YUE_OBJECT_SYMBOL) {
-        mark(ctx, obj->as_symbol.value);
+        obj->marked = true;
+        yue_Object *next = NULL;
+        if(obj->type == YUE_OBJECT_PAIR) {
+            mark(ctx, obj->as_pair.head);
+            next = obj->as_pair.tail;
+        } else if(obj->type == YUE_OBJECT_STRING) {
+            next = obj->as_str.tail;
+        } else if(obj->type == YUE_OBJECT_FUNC || obj->type == YUE_OBJECT_MACRO) {
+            mark(ctx, obj->as_func.params);
+            if(obj->as_func.module) mark(ctx, obj->as_func.module);
+            next = obj->as_func.body;
+        } else if(obj->type == YUE_OBJECT_SYMBOL) {
+            next = obj->as_symbol.value;
+        } else if(obj->type == YUE_OBJECT_SEQ) {
+            if(obj->as_seq->fn) mark(ctx, obj->as_seq->fn);
+            next = obj->as_seq->source;
+        } else if(obj->type == YUE_OBJECT_MEMO) {
+            _yue_memo_mark(ctx, obj->as_memo);
+        } else if(obj->type == YUE_OBJECT_BATCH) {
+            _yue_batch_mark(ctx, obj->as_batch);
+        } else if(obj->type == YUE_OBJECT_MODULE) {
+            _yue_module_mark(ctx, obj->as_module);
+        } else if(obj->type == YUE_OBJECT_RECORD) {
+            _yue_record_mark(ctx, obj->as_record);
+            next = obj->as_record->type;
+        } else if(obj->type == YUE_OBJECT_COROUTINE) {
+            yue_Coroutine *co = obj->as_coroutine;
+            mark(ctx, co->fn);
+            mark(ctx, co->value);
+            // a running coroutine's roots are the context's roots
+            if(co->state == YUE_COROUTINE_SUSPENDED) {
+                for(size_t i = 0; i < co->frame.stack_size; ++i) mark(ctx, co->stack[i]);
+                for(size_t i = 1; i < co->frame.scope_size; ++i) {
+                    for(yue_Object *sym = co->scope[i]; sym; sym = sym->next) mark(ctx, sym);
+                }
+            }
+        }
+        obj = next;
     }
 }
 
-static void mark_all(yue_Context *ctx)
+static void mark_frame(yue_Context *ctx, yue_Object **stack, size_t stack_size, yue_Object **scope, size_t scope_size)
 {
-    for(size_t i = 0; i < ctx->stack_size; ++i) {
-        mark(ctx, ctx->stack[i]);
+    for(size_t i = 0; i < stack_size; ++i) {
+        mark(ctx, stack[i]);
     }
-    for(size_t i = 0; i < ctx->scope_size; ++i) {
-        yue_Object *obj = ctx->scope[i];
+    for(size_t i = 0; i < scope_size; ++i) {
+        yue_Object *obj = scope[i];
         while(obj) {
             mark(ctx, obj);
             obj = obj->next;
@@ -352,26 +1621,155 @@ static void mark_all(yue_Context *ctx)
     }
 }
 
+#if defined(__linux__)
+static void _yue_loop_mark(yue_Context *ctx);
+static void _yue_loop_close(yue_Context *ctx);
+#endif
+
+static void mark_all(yue_Context *ctx)
+{
+    if(ctx->base.bindings) mark(ctx, ctx->base.bindings);
+    if(ctx->base.snapshots) mark(ctx, ctx->base.snapshots);
+    if(ctx->modules) mark(ctx, ctx->modules);
+    if(ctx->plugins) mark(ctx, ctx->plugins);
+#if defined(__linux__)
+    if(ctx->loop) _yue_loop_mark(ctx);
+#endif
+    // frames of whoever resumed the running coroutines
+    for(yue_Coroutine *co = ctx->coroutine; co; co = co->frame.coroutine) {
+        mark_frame(ctx, co->frame.stack, co->frame.stack_size, co->frame.scope, co->frame.scope_size);
+    }
+    mark_frame(ctx, ctx->stack, ctx->stack_size, ctx->scope, ctx->scope_size);
+}
+
+static void _yue_seq_free(yue_Seq *seq)
+{
+    if(seq->destroy) seq->destroy(seq);
+    free(seq);
+}
+
 static void sweep(yue_Context *ctx)
 {
     ctx->free_list = NULL;
-    for(size_t i = 0; i < ctx->count_objects; ++i) {
+    ctx->gc.marked = 0;
+    ctx->gc.freed  = 0;
+    yue_HeapProfile *heap = ctx->heap_profile && ctx->heap_profile->running ? ctx->heap_profile : NULL;
+    if(heap) for(uint32_t i = 0; i < heap->count_sites; ++i) heap->sites[i].retained = 0;
+    for(size_t i = 0; i < ctx->fresh_objects; ++i) {
         yue_Object *obj = &ctx->objects[i];
         if(obj->marked) {
             obj->marked = false;
+            ctx->gc.marked += 1;
+            if(heap) heap->sites[heap->tags[i]].retained += 1;
         } else {
             if(obj->type == YUE_OBJECT_RESOURCE)
                 obj->as_resource.destroy(obj->as_resource.data);
+            if(obj->type == YUE_OBJECT_COROUTINE)
+                free(obj->as_coroutine);
+            if(obj->type == YUE_OBJECT_SEQ)
+                _yue_seq_free(obj->as_seq);
+            if(obj->type == YUE_OBJECT_MEMO)
+                _yue_memo_free(obj->as_memo);
+            if(obj->type == YUE_OBJECT_BATCH)
+                _yue_batch_free(obj->as_batch);
+            if(obj->type == YUE_OBJECT_MODULE)
+                free(obj->as_module);
+            if(obj->type == YUE_OBJECT_RECORD)
+                free(obj->as_record);
+            // so freed resources are not destroyed again by the next sweep
+            obj->type = YUE_OBJECT_NIL;
             obj->next = ctx->free_list;
             ctx->free_list = obj;
+            ctx->gc.freed += 1;
         }
     }
 }
 
+static uint64_t _yue_now_ns(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
 void yue_rungc(yue_Context *ctx)
 {
+    yue_CounterSet counted;
+    bool counting = ctx->counters && ctx->counters->running;
+    if(counting) yue_counters_begin(ctx, &counted);
+    if(ctx->trace && ctx->trace->running) yue_trace_event(ctx, YUE_TRACE_GC_BEGIN, NULL, 0);
+    uint64_t start = _yue_now_ns();
     mark_all(ctx);
     sweep(ctx);
+    double pause = (double)(_yue_now_ns() - start) / 1e6;
+    if(counting) {
+        yue_counters_end(ctx, &counted);
+        _yue_counters_add(&ctx->counters->gc, &counted);
+        ctx->counters->collections += 1;
+    }
+    ctx->gc.collections    += 1;
+    ctx->gc.total_pause_ms += pause;
+    if(pause > ctx->gc.max_pause_ms) ctx->gc.max_pause_ms = pause;
+    ctx->gc.total_freed    += ctx->gc.freed;
+    if(ctx->trace && ctx->trace->running) yue_trace_event(ctx, YUE_TRACE_GC_END, NULL, ctx->gc.freed);
+    if(ctx->heap_profile && ctx->heap_profile->running) _yue_heap_collected(ctx->heap_profile);
+}
+
+// YUE_OBJECT_PAIR is reported as pair
+static const char *_yue_type_label(int type, char *dst, size_t dstsz)
+{
+    snprintf(dst, dstsz, "%s", _yue_type_names[type] + strlen("YUE_OBJECT_"));
+    for(char *c = dst; *c; ++c) if(*c >= 'A' && *c <= 'Z') *c += 'a' - 'A';
+    return dst;
+}
+
+void yue_gcstats(yue_Context *ctx, yue_GCStats *stats)
+{
+    *stats = ctx->gc;
+    stats->fresh_objects = ctx->fresh_objects;
+    stats->count_objects = ctx->count_objects;
+    stats->free_list = 0;
+    for(yue_Object *obj = ctx->free_list; obj; obj = obj->next) stats->free_list += 1;
+    // the unswept half of a collection
+    mark_all(ctx);
+    for(size_t i = 0; i < ctx->fresh_objects; ++i) {
+        yue_Object *obj = &ctx->objects[i];
+        if(!obj->marked) continue;
+        obj->marked = false;
+        stats->live[obj->type] += 1;
+    }
+}
+
+void yue_gcstats_report(yue_Context *ctx, FILE *f)
+{
+    yue_GCStats stats = {0};
+    yue_gcstats(ctx, &stats);
+    // one write, so the summaries of contexts on other threads don't interleave
+    char buf[2048];
+    int len = snprintf(buf, sizeof(buf),
+        "gc: %zu allocations, %zu collections, %.3f ms paused (max %.3f ms)\n"
+        "gc: last collection marked %zu and freed %zu, %zu freed in total\n"
+        "gc: %zu of %zu objects used, %zu on the free list\n"
+        "gc: high water %zu roots, %zu scopes\n"
+        "gc: live",
+        stats.allocations, stats.collections, stats.total_pause_ms, stats.max_pause_ms,
+        stats.marked, stats.freed, stats.total_freed,
+        stats.fresh_objects, stats.count_objects, stats.free_list,
+        stats.stack_high_water, stats.scope_high_water);
+    for(int type = 0; type < YUE_OBJECT_TYPE_COUNT && len < (int)sizeof(buf); ++type) {
+        if(stats.live[type] == 0) continue;
+        char name[32];
+        len += snprintf(buf + len, sizeof(buf) - len, " %zu %s", stats.live[type], _yue_type_label(type, name, sizeof(name)));
+    }
+    if(len < (int)sizeof(buf) - 1) len += snprintf(buf + len, sizeof(buf) - len, "\n");
+    fwrite(buf, 1, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1, f);
 }
 
 size_t yue_savegc(yue_Context *ctx)
@@ -389,17 +1787,23 @@ static void yue_pushgc(yue_Context *ctx, yue_Object *obj)
     assert(obj && "Invalid object to push");
     if(ctx->stack_size >= YUE_STACK_CAP) yue_error(ctx, "Stack overflow!");
     ctx->stack[ctx->stack_size++] = obj;
+    if(ctx->stack_size > ctx->gc.stack_high_water) ctx->gc.stack_high_water = ctx->stack_size;
 }
 
 void yue_set(yue_Context *ctx, yue_Object *sym, yue_Object *value)
 {
     if(sym->type != YUE_OBJECT_SYMBOL) 
         yue_error(ctx, "set require the first argument to be symbol but found %s\n", _yue_type_names[sym->type]);
-    for(int i = (int)ctx->scope_size - 1; i >= 0; --i) {
+    for(int i = (int)ctx->scope_size - 1; i >= (int)ctx->module_scope; --i) {
         yue_Object *obj = ctx->scope[i];
         while(obj) {
             if(obj->type == YUE_OBJECT_SYMBOL) {
                 if(strcmp(sym->as_symbol.name, obj->as_symbol.name) == 0) {
+                    // bindings of another context (see pmap) are read-only, they're shadowed instead
+                    if(!_yue_owns(ctx, obj)) {
+                        _yue_bind(ctx, sym, value);
+                        return;
+                    }
                     obj->as_symbol.value = value;
                     yue_pushgc(ctx, obj);
                     return;
@@ -408,31 +1812,71 @@ void yue_set(yue_Context *ctx, yue_Object *sym, yue_Object *value)
             obj = obj->next;
         }
     }
-    sym->as_symbol.value = value;
-    sym->next = ctx->scope[ctx->scope_size - 1];
-    ctx->scope[ctx->scope_size - 1] = sym;
+    _yue_bind(ctx, sym, value);
 }
 
-yue_Object *yue_get(yue_Context *ctx, yue_Object *sym)
+// The innermost binding of name, NULL when it's not bound
+static yue_Object *_yue_lookup(yue_Context *ctx, const char *name)
 {
-    if(sym->type != YUE_OBJECT_SYMBOL) yue_error(ctx, "set require the first argument to be symbol\n");
     for(int i = (int)ctx->scope_size - 1; i >= 0; --i) {
         yue_Object *obj = ctx->scope[i];
         while(obj) {
             if(obj->type == YUE_OBJECT_SYMBOL) {
-                if(strcmp(sym->as_symbol.name, obj->as_symbol.name) == 0) {
-                    return obj->as_symbol.value;
+                if(strcmp(name, obj->as_symbol.name) == 0) {
+                    return obj;
                 }
             }
             obj = obj->next;
         }
     }
-    return yue_nil(ctx);
+    return NULL;
+}
+
+yue_Object *yue_get(yue_Context *ctx, yue_Object *sym)
+{
+    if(sym->type != YUE_OBJECT_SYMBOL) yue_error(ctx, "set require the first argument to be symbol\n");
+    yue_Object *binding = _yue_lookup(ctx, sym->as_symbol.name);
+    if(binding) return binding->as_symbol.value;
+    if(ctx->builtins || ctx->io) {
+        yue_Object *value = _yue_builtin_get(ctx, sym->as_symbol.name);
+        if(value) return value;
+    }
+    if(ctx->plugins) {
+        yue_Object *value = _yue_plugin_get(ctx, sym->as_symbol.name);
+        if(value) return value;
+    }
+    return _yue_module_get(ctx, sym->as_symbol.name);
+}
+
+// Binds a lazily loaded builtin or plugin export, the next lookups find it like any other global
+static void _yue_bind_global(yue_Context *ctx, const char *name, yue_Object *value)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_pushgc(ctx, value);
+    yue_Object *binding = new_object(ctx, YUE_OBJECT_SYMBOL);
+    snprintf(binding->as_symbol.name, YUE_STRING_DATA_SIZE, "%s", name);
+    binding->as_symbol.value = value;
+    binding->next = ctx->scope[0];
+    ctx->scope[0] = binding;
+    yue_restoregc(ctx, gc);
 }
 
 
 static yue_Object *new_object(yue_Context *ctx, yue_ObjectType type)
 {
+    yue_Object *result = NULL;
+    ctx->gc.allocations += 1;
+    if((ctx->gc.allocations & (YUE_TRACE_BURST - 1)) == 0 && ctx->trace && ctx->trace->running) {
+        yue_trace_event(ctx, YUE_TRACE_ALLOC, NULL, YUE_TRACE_BURST);
+    }
+    if(ctx->free_list == NULL && ctx->fresh_objects < ctx->count_objects) {
+        result = &ctx->objects[ctx->fresh_objects++];
+        result->marked = false;
+        result->next   = NULL;
+        result->type   = type;
+        if(ctx->heap_profile && ctx->heap_profile->running) _yue_heap_tag(ctx, result);
+        return result;
+    }
     if(ctx->free_list == NULL) {
         yue_rungc(ctx);
         if(ctx->free_list == NULL) {
@@ -440,9 +1884,10 @@ static yue_Object *new_object(yue_Context *ctx, yue_ObjectType type)
             return NULL;
         }
     }
-    yue_Object *result = ctx->free_list;
+    result = ctx->free_list;
     result->type = type;
     ctx->free_list = ctx->free_list->next;
+    if(ctx->heap_profile && ctx->heap_profile->running) _yue_heap_tag(ctx, result);
     return result;
 }
 
@@ -462,6 +1907,11 @@ yue_Object *yue_userdata(yue_Context *ctx, void *userdata)
 
 yue_Object *yue_number(yue_Context *ctx, yue_Number number)
 {
+    int small = (int)number;
+    // -0 keeps its sign
+    if(small >= 0 && small < YUE_SMALL_INTS && (yue_Number)small == number && (small != 0 || 1 / number > 0)) {
+        return &ctx->numbers[small];
+    }
     yue_Object *obj = new_object(ctx, YUE_OBJECT_NUMBER);
     obj->as_number = number;
     yue_pushgc(ctx, obj);
@@ -479,10 +1929,14 @@ yue_Object *yue_pair(yue_Context *ctx, yue_Object *head, yue_Object *tail)
 
 yue_Object *yue_list(yue_Context *ctx, yue_Object **objs, size_t count) 
 {
+    size_t gc = yue_savegc(ctx);
     yue_Object *res = yue_nil(ctx);
     while(count--) {
         res = yue_pair(ctx, objs[count], res);
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, res);
     }
+    yue_restoregc(ctx, gc);
     yue_pushgc(ctx, res);
     return res;
 }
@@ -546,6 +2000,7 @@ yue_Object *yue_func(yue_Context *ctx, yue_Object *params, yue_Object *body)
     yue_Object *obj = new_object(ctx, YUE_OBJECT_FUNC);
     obj->as_func.body = body;
     obj->as_func.params = params;
+    obj->as_func.module = ctx->module;
     yue_pushgc(ctx, obj);
     return obj;
 }
@@ -635,7 +2090,7 @@ char *yue_tostring(yue_Context *ctx, yue_Object *obj, char *dst, size_t dstsz)
         yue_Object *tail = curr->as_str.tail;
         if(tail) {
             size_t n = cap < YUE_STRING_DATA_SIZE ? cap : YUE_STRING_DATA_SIZE;
-            memcpy(dst, curr->as_str.data, n);
+            memcpy(base, curr->as_str.data, n);
             base += n;
             cap -= n;
         } else {
@@ -679,15 +2134,52 @@ static void print_object_inner(yue_Object *obj, int level)
         case YUE_OBJECT_CFUNC:
             printf("<cfunc>");
             break;
+        case YUE_OBJECT_NATIVE:
+            printf("<native %s>", obj->as_native->name);
+            break;
         case YUE_OBJECT_FUNC:
             printf("<func>");
             break;
+        case YUE_OBJECT_MACRO:
+            printf("<macro>");
+            break;
         case YUE_OBJECT_USERDATA:
             printf("<userdata: %p>", obj->as_userdata);
             break;
         case YUE_OBJECT_RESOURCE:
             printf("<resource: %p>", obj->as_userdata);
             break;
+        case YUE_OBJECT_COROUTINE:
+            printf("<coroutine: %p>", (void*)obj->as_coroutine);
+            break;
+        case YUE_OBJECT_SEQ:
+            printf("<seq: %p>", (void*)obj->as_seq);
+            break;
+        case YUE_OBJECT_MEMO:
+            printf("<memo: %p>", (void*)obj->as_memo);
+            break;
+        case YUE_OBJECT_BATCH:
+            printf("<batch: %p>", (void*)obj->as_batch);
+            break;
+        case YUE_OBJECT_MODULE:
+            printf("<module %s>", obj->as_module->path);
+            break;
+        case YUE_OBJECT_RECORD:
+            {
+                yue_Record *record = obj->as_record;
+                if(record->kind == YUE_RECORD_TYPE) {
+                    printf("<record: %s>", record->type->as_symbol.name);
+                } else if(record->kind != YUE_RECORD_INSTANCE) {
+                    printf("<accessor: %s>", record->type->as_record->type->as_symbol.name);
+                } else {
+                    printf("<%s:", record->type->as_record->type->as_symbol.name);
+                    for(size_t i = 0; i < record->count; ++i) {
+                        printf(" ");
+                        print_object_inner(record->slots[i], level + 1);
+                    }
+                    printf(">");
+                }
+            } break;
         case YUE_OBJECT_NUMBER:
             printf("%f", obj->as_number);
             break;
@@ -721,12 +2213,26 @@ static void print_object_inner(yue_Object *obj, int level)
 yue_Object *yue_builtin_print(yue_Context *ctx, yue_Object *arg)
 {
     size_t gc = yue_savegc(ctx);
-    yue_Object *a = NULL;
-    while(!yue_isnil((a = yue_nextarg(ctx, &arg)))) {
-        print_object_inner(yue_eval(ctx, a), 0);
+    // evaluate everything first so the line is written in one go when
+    // several contexts are printing from different threads, the values
+    // are kept in a list so the root stack holds one slot however many
+    // arguments there are
+    yue_Object *values = _eval_list(ctx, arg);
+#ifdef _WIN32
+    _lock_file(stdout);
+#else
+    flockfile(stdout);
+#endif
+    for(yue_Object *v = values; v->type == YUE_OBJECT_PAIR; v = v->as_pair.tail) {
+        print_object_inner(v->as_pair.head, 0);
         printf(" ");
     }
     printf("\n");
+#ifdef _WIN32
+    _unlock_file(stdout);
+#else
+    funlockfile(stdout);
+#endif
     yue_restoregc(ctx, gc);
     return yue_nil(ctx);
 }
@@ -771,14 +2277,14 @@ yue_Object *yue_builtin_dolist(yue_Context *ctx, yue_Object *arg)
 {
     size_t gc = yue_savegc(ctx);
     yue_Object *a = NULL;
-    size_t eval_gc = yue_savegc(ctx);
+    yue_Object *res = yue_nil(ctx);
     while(!yue_isnil((a = yue_nextarg(ctx, &arg)))) {
         yue_restoregc(ctx, gc);
-        a = yue_eval(ctx, a);
+        res = yue_eval(ctx, a);
     }
     yue_restoregc(ctx, gc);
-    yue_pushgc(ctx, a);
-    return a;
+    yue_pushgc(ctx, res);
+    return res;
 }
 
 yue_Object *yue_builtin_assign(yue_Context *ctx, yue_Object *arg) 
@@ -800,6 +2306,7 @@ yue_Object *yue_builtin_while(yue_Context *ctx, yue_Object *arg)
     size_t eval_gc = yue_savegc(ctx);
     for(;;) {
         yue_restoregc(ctx, eval_gc);
+        _yue_charge(ctx);
         if(yue_isnil(yue_eval(ctx, cond))) break;
         res = yue_eval(ctx, body);
     }
@@ -813,13 +2320,14 @@ yue_Object *yue_builtin_if(yue_Context *ctx, yue_Object *arg)
     yue_Object *cond = yue_nextarg(ctx, &arg);
     yue_Object *if_true  = yue_nextarg(ctx, &arg);
     yue_Object *if_false = yue_nextarg(ctx, &arg);
+    yue_Object *res = NULL;
     if(!yue_isnil(yue_eval(ctx, cond))) {
-        yue_eval(ctx, if_true);
+        res = yue_eval(ctx, if_true);
     } else {
-        yue_eval(ctx, if_false);
+        res = yue_eval(ctx, if_false);
     }
     yue_restoregc(ctx, eval_gc);
-    yue_Object *res  = yue_nil(ctx);
+    yue_pushgc(ctx, res);
     return res;
 }
 
@@ -931,6 +2439,28 @@ yue_Object *yue_builtin_ne(yue_Context *ctx, yue_Object *arg)
     }
 }
 
+static bool _yue_equal(yue_Object *lhs, yue_Object *rhs)
+{
+    if(lhs->type != rhs->type) return false;
+    switch(lhs->type) {
+    case YUE_OBJECT_NIL:
+        // every context and code segment has its own nil
+        return true;
+    case YUE_OBJECT_STRING:
+        return yue_streq(lhs, rhs);
+    case YUE_OBJECT_SYMBOL:
+        // the same name read twice is two objects
+        return strcmp(lhs->as_symbol.name, rhs->as_symbol.name) == 0;
+    case YUE_OBJECT_NUMBER:
+        {
+            double diff = lhs->as_number - rhs->as_number;
+            return -YUE_FLOAT_EPSILON < diff && diff < YUE_FLOAT_EPSILON;
+        }
+    default:
+        return lhs == rhs;
+    }
+}
+
 yue_Object *yue_builtin_eq(yue_Context *ctx, yue_Object *arg)
 {
     size_t gc = yue_savegc(ctx);
@@ -938,16 +2468,7 @@ yue_Object *yue_builtin_eq(yue_Context *ctx, yue_Object *arg)
     yue_Object *rhs = yue_eval(ctx, yue_nextarg(ctx, &arg));
     yue_restoregc(ctx, gc);
 
-    if(lhs->type != rhs->type) return yue_nil(ctx);
-    if(lhs->type == YUE_OBJECT_STRING) {
-        return yue_streq(lhs, rhs) ? yue_number(ctx, 1) : yue_nil(ctx);
-    }
-    if(lhs->type == YUE_OBJECT_NUMBER) {
-        double diff = lhs->as_number - rhs->as_number;
-        bool equal = -YUE_FLOAT_EPSILON < diff && diff < YUE_FLOAT_EPSILON;
-        return equal ? yue_number(ctx, 1) : yue_nil(ctx);
-    }
-    return lhs == rhs ? yue_number(ctx, 1) : yue_nil(ctx);
+    return _yue_equal(lhs, rhs) ? yue_number(ctx, 1) : yue_nil(ctx);
 }
 
 yue_Object *yue_builtin_streq(yue_Context *ctx, yue_Object *arg)
@@ -965,13 +2486,90 @@ yue_Object *yue_builtin_exit(yue_Context *ctx, yue_Object *arg)
     size_t gc = yue_savegc(ctx);
     int exit_code = yue_tonumber(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)));
     yue_restoregc(ctx, gc);
-    // TODO: maybe exit should be a flag in ctx that we can change 
-    //       so when it's exit we refuse to do anymore evaluation
-    //       or spit error.
-    exit(exit_code);
+    // unwinds to the host when there's one, `try` doesn't catch this
+    ctx->exit_code = exit_code;
+    _yue_throw(ctx, YUE_EXIT);
     return yue_nil(ctx);
 }
 
+// (try body handler)
+// If body raises an error, handler is evaluated instead. When handler is 
+// a function it's called with the error message.
+yue_Object *yue_builtin_try(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *body    = yue_nextarg(ctx, &arg);
+    yue_Object *handler = yue_nextarg(ctx, &arg);
+    yue_Object *res = NULL;
+    yue_Status status = yue_peval(ctx, body, &res);
+    if(status == YUE_EXIT) _yue_throw(ctx, status);
+    if(status == YUE_ERROR) {
+        res = yue_eval(ctx, handler);
+        if(res->type == YUE_OBJECT_FUNC) {
+            yue_Object *message = yue_string(ctx, ctx->error);
+            res = yue_eval(ctx, yue_pair(ctx, res, yue_pair(ctx, message, yue_nil(ctx))));
+        }
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+yue_Object *yue_builtin_quote(yue_Context *ctx, yue_Object *arg)
+{
+    return yue_nextarg(ctx, &arg);
+}
+
+yue_Object *yue_call(yue_Context *ctx, yue_Object *fn, yue_Object *args)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_pushgc(ctx, fn);
+    yue_pushgc(ctx, args);
+    yue_Object *res = NULL;
+    switch(fn->type) {
+    case YUE_OBJECT_FUNC:
+        res = _yue_invoke(ctx, fn, args);
+        break;
+    case YUE_OBJECT_NATIVE:
+        res = _yue_native_call(ctx, fn, args, false);
+        break;
+    case YUE_OBJECT_CFUNC:
+        {
+            // builtins evaluate their arguments, so quote whatever doesn't evaluate to itself
+            yue_Object *quote = yue_cfunc(ctx, yue_builtin_quote);
+            yue_Object *root = yue_nil(ctx);
+            yue_Object *prev = NULL;
+            while(args->type == YUE_OBJECT_PAIR) {
+                yue_Object *value = args->as_pair.head;
+                if(value->type == YUE_OBJECT_SYMBOL || value->type == YUE_OBJECT_PAIR) {
+                    value = yue_pair(ctx, quote, yue_pair(ctx, value, yue_nil(ctx)));
+                }
+                yue_Object *curr = yue_pair(ctx, value, yue_nil(ctx));
+                if(prev) {
+                    prev->as_pair.tail = curr;
+                } else {
+                    root = curr;
+                }
+                prev = curr;
+                args = args->as_pair.tail;
+            }
+            res = fn->as_cfunc(ctx, root);
+        } break;
+    case YUE_OBJECT_MEMO:
+        res = _yue_memo_call(ctx, fn, args);
+        break;
+    case YUE_OBJECT_RECORD:
+        res = _yue_record_call(ctx, fn, args, false);
+        break;
+    default:
+        yue_error(ctx, "Invoking non callable object %s", _yue_type_names[fn->type]);
+        break;
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
 yue_Object *yue_builtin_fn(yue_Context *ctx, yue_Object *arg)
 {
     yue_Object *params = yue_nextarg(ctx, &arg);
@@ -984,6 +2582,7 @@ yue_Object *yue_builtin_list(yue_Context *ctx, yue_Object *arg)
     size_t gc = yue_savegc(ctx);
     yue_Object *result = _eval_list(ctx, arg);
     yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, result);
     return result;
 }
 
@@ -1001,110 +2600,4905 @@ yue_Object *yue_builtin_tail(yue_Context *ctx, yue_Object *arg)
     size_t gc = yue_savegc(ctx);
     yue_Object *list = yue_eval(ctx, yue_nextarg(ctx, &arg));
     yue_restoregc(ctx, gc);
-    if(list->type != YUE_OBJECT_PAIR) yue_error(ctx, "`head` requires a list");
+    if(list->type != YUE_OBJECT_PAIR) yue_error(ctx, "`tail` requires a list");
     return list->as_pair.tail;
 }
 
-void yue_load_builtins(yue_Context *ctx)
+// Builds a list front to back, only its root is kept on the root stack
+typedef struct yue_ListBuilder {
+    size_t gc;
+    yue_Object *root;
+    yue_Object *last;
+} yue_ListBuilder;
+
+static void _yue_builder_init(yue_Context *ctx, yue_ListBuilder *builder)
+{
+    builder->gc   = yue_savegc(ctx);
+    builder->root = yue_nil(ctx);
+    builder->last = NULL;
+}
+
+static void _yue_builder_push(yue_Context *ctx, yue_ListBuilder *builder, yue_Object *value)
+{
+    yue_pushgc(ctx, value);
+    yue_Object *curr = yue_pair(ctx, value, yue_nil(ctx));
+    if(builder->last) {
+        builder->last->as_pair.tail = curr;
+    } else {
+        builder->root = curr;
+    }
+    builder->last = curr;
+    yue_restoregc(ctx, builder->gc);
+    yue_pushgc(ctx, builder->root);
+}
+
+static yue_Object *_yue_expect_list(yue_Context *ctx, yue_Object *obj, const char *name)
+{
+    if(obj->type != YUE_OBJECT_PAIR && obj->type != YUE_OBJECT_NIL) 
+        yue_error(ctx, "`%s` requires a list but found %s", name, _yue_type_names[obj->type]);
+    return obj;
+}
+
+// (length l), the number of elements of a list or the length of a string
+yue_Object *yue_builtin_length(yue_Context *ctx, yue_Object *arg)
 {
     size_t gc = yue_savegc(ctx);
-    yue_set(ctx, yue_symbol(ctx, "print"), yue_cfunc(ctx, yue_builtin_print));
-    yue_set(ctx, yue_symbol(ctx, "+"), yue_cfunc(ctx, yue_builtin_add));
-    yue_set(ctx, yue_symbol(ctx, "-"), yue_cfunc(ctx, yue_builtin_sub));
-    yue_set(ctx, yue_symbol(ctx, "*"), yue_cfunc(ctx, yue_builtin_mul));
-    yue_set(ctx, yue_symbol(ctx, "="), yue_cfunc(ctx, yue_builtin_assign));
-    yue_set(ctx, yue_symbol(ctx, "not"), yue_cfunc(ctx, yue_builtin_not));
-    yue_set(ctx, yue_symbol(ctx, "and"), yue_cfunc(ctx, yue_builtin_and));
-    yue_set(ctx, yue_symbol(ctx, "or"), yue_cfunc(ctx, yue_builtin_or));
-    yue_set(ctx, yue_symbol(ctx, "eq"), yue_cfunc(ctx, yue_builtin_eq));
-    yue_set(ctx, yue_symbol(ctx, "ne"), yue_cfunc(ctx, yue_builtin_ne));
-    yue_set(ctx, yue_symbol(ctx, "lt"), yue_cfunc(ctx, yue_builtin_lt));
-    yue_set(ctx, yue_symbol(ctx, "gt"), yue_cfunc(ctx, yue_builtin_gt));
-    yue_set(ctx, yue_symbol(ctx, "le"), yue_cfunc(ctx, yue_builtin_le));
-    yue_set(ctx, yue_symbol(ctx, "ge"), yue_cfunc(ctx, yue_builtin_ge));
-    yue_set(ctx, yue_symbol(ctx, "exit"), yue_cfunc(ctx, yue_builtin_exit));
-    yue_set(ctx, yue_symbol(ctx, "do"), yue_cfunc(ctx, yue_builtin_dolist));
-    yue_set(ctx, yue_symbol(ctx, "while"), yue_cfunc(ctx, yue_builtin_while));
-    yue_set(ctx, yue_symbol(ctx, "if"), yue_cfunc(ctx, yue_builtin_if));
-    yue_set(ctx, yue_symbol(ctx, "fn"), yue_cfunc(ctx, yue_builtin_fn));
-    yue_set(ctx, yue_symbol(ctx, "list"), yue_cfunc(ctx, yue_builtin_list));
-    yue_set(ctx, yue_symbol(ctx, "head"), yue_cfunc(ctx, yue_builtin_head));
-    yue_set(ctx, yue_symbol(ctx, "tail"), yue_cfunc(ctx, yue_builtin_tail));
-    yue_set(ctx, yue_symbol(ctx, "streq"), yue_cfunc(ctx, yue_builtin_streq));
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
     yue_restoregc(ctx, gc);
+    if(obj->type == YUE_OBJECT_STRING) return yue_number(ctx, (yue_Number)yue_getstringlen(ctx, obj));
+    size_t count = 0;
+    for(obj = _yue_expect_list(ctx, obj, "length"); obj->type == YUE_OBJECT_PAIR; obj = obj->as_pair.tail) count += 1;
+    return yue_number(ctx, (yue_Number)count);
 }
 
-static inline bool _isdigit(int c) { return '0' <= c && c <= '9'; }
-static inline bool _isspace(int c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+// (nth l n), the n'th element starting from 0 or nil past the end
+yue_Object *yue_builtin_nth(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *list = _yue_expect_list(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "nth");
+    yue_pushgc(ctx, list);
+    yue_Object *index = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    if(index->type != YUE_OBJECT_NUMBER || index->as_number < 0) yue_error(ctx, "`nth` requires a positive index");
+    for(size_t n = (size_t)index->as_number; list->type == YUE_OBJECT_PAIR; list = list->as_pair.tail, --n) {
+        if(n == 0) return list->as_pair.head;
+    }
+    return yue_nil(ctx);
+}
 
-yue_Object *yue_read(yue_Context *ctx, yue_File *source)
+// (append l...), the elements of every list in a new list that shares the last one
+yue_Object *yue_builtin_append(yue_Context *ctx, yue_Object *arg)
 {
-    while(_isspace(*source->ptr)) source->ptr++;
-    if(source->ptr >= source->eof) return yue_nil(ctx);
-    if(*source->ptr == '"') {
-        source->ptr++;
-        const char *start = source->ptr;
-        while(source->ptr < source->eof && *source->ptr != '"') source->ptr++;
-        size_t size = source->ptr - start;
-        source->ptr++;
-        return yue_string_sized(ctx, start, size);
-    } else if(_isdigit(*source->ptr)) {
-        yue_Number val = 0;
-        while(source->ptr < source->eof) {
-            if(_isdigit(*source->ptr)) {
-                val *= 10;
-                val += *source->ptr - '0';
-                source->ptr++;
+    size_t gc = yue_savegc(ctx);
+    yue_Object *lists = _eval_list(ctx, arg);
+    yue_ListBuilder builder;
+    _yue_builder_init(ctx, &builder);
+    for(; lists->type == YUE_OBJECT_PAIR; lists = lists->as_pair.tail) {
+        yue_Object *list = _yue_expect_list(ctx, lists->as_pair.head, "append");
+        if(lists->as_pair.tail->type != YUE_OBJECT_PAIR) {
+            if(builder.last) {
+                builder.last->as_pair.tail = list;
             } else {
-                break;
+                builder.root = list;
             }
+            break;
         }
-        return yue_number(ctx, val);
-    } else if(*source->ptr == '(') {
-        source->ptr++;
-        while(_isspace(*source->ptr)) source->ptr++;
-        if(source->ptr < source->eof && *source->ptr == ')') {
-            source->ptr++; // empty list
-            return yue_nil(ctx);
+        for(; list->type == YUE_OBJECT_PAIR; list = list->as_pair.tail) _yue_builder_push(ctx, &builder, list->as_pair.head);
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, builder.root);
+    return builder.root;
+}
+
+// (reverse l)
+yue_Object *yue_builtin_reverse(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *list = _yue_expect_list(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "reverse");
+    yue_pushgc(ctx, list);
+    size_t top = yue_savegc(ctx);
+    yue_Object *res = yue_nil(ctx);
+    for(; list->type == YUE_OBJECT_PAIR; list = list->as_pair.tail) {
+        res = yue_pair(ctx, list->as_pair.head, res);
+        yue_restoregc(ctx, top);
+        yue_pushgc(ctx, res);
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (assoc key alist), the first (key . value) pair of alist with that key, or nil
+yue_Object *yue_builtin_assoc(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *key = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, key);
+    yue_Object *list = _yue_expect_list(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "assoc");
+    yue_restoregc(ctx, gc);
+    for(; list->type == YUE_OBJECT_PAIR; list = list->as_pair.tail) {
+        yue_Object *entry = list->as_pair.head;
+        if(entry->type == YUE_OBJECT_PAIR && _yue_equal(entry->as_pair.head, key)) return entry;
+    }
+    return yue_nil(ctx);
+}
+
+// (member x l), the rest of l starting with x, or nil
+yue_Object *yue_builtin_member(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *value = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, value);
+    yue_Object *list = _yue_expect_list(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "member");
+    yue_restoregc(ctx, gc);
+    for(; list->type == YUE_OBJECT_PAIR; list = list->as_pair.tail) {
+        if(_yue_equal(list->as_pair.head, value)) return list;
+    }
+    return yue_nil(ctx);
+}
+
+typedef struct yue_Sort {
+    yue_Object **items;
+    yue_Object **tmp;
+    size_t count;
+    // NULL for numbers and strings
+    yue_Object *cmp;
+    bool strings;
+} yue_Sort;
+
+static int _yue_strcmp(yue_Object *a, yue_Object *b)
+{
+    while(a && b) {
+        for(size_t i = 0; i < YUE_STRING_DATA_SIZE; ++i) {
+            unsigned char c_a = a->as_str.data[i];
+            unsigned char c_b = b->as_str.data[i];
+            if(c_a != c_b) return c_a < c_b ? -1 : 1;
+            if(c_a == 0) return 0;
         }
+        a = a->as_str.tail;
+        b = b->as_str.tail;
+    }
+    return a ? 1 : b ? -1 : 0;
+}
 
-        size_t gc = yue_savegc(ctx);
-        yue_Object *r =  yue_read(ctx, source);
-        yue_Object *root = yue_pair(ctx, r, yue_nil(ctx));
-        yue_Object *prev = root;
-        for(;;) {
-            while(source->ptr < source->eof && _isspace(*source->ptr)) source->ptr++;
-            if(source->ptr >= source->eof) yue_error(ctx, "Unclosed '('");
-            if(*source->ptr == ')') {
-                source->ptr++;
-                break;
+// Whether b has to come before a
+static bool _yue_sort_before(yue_Context *ctx, yue_Sort *sort, yue_Object *b, yue_Object *a)
+{
+    if(!sort->cmp) {
+        if(sort->strings) return _yue_strcmp(b, a) < 0;
+        return b->as_number < a->as_number;
+    }
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = yue_call(ctx, sort->cmp, yue_pair(ctx, b, yue_pair(ctx, a, yue_nil(ctx))));
+    yue_restoregc(ctx, gc);
+    return !yue_isnil(res);
+}
+
+// Bottom-up merge sort, stable since the right run only goes first when it's strictly before
+static yue_Object *_yue_sort_items(yue_Context *ctx, void *arg)
+{
+    yue_Sort *sort = arg;
+    yue_Object **src = sort->items;
+    yue_Object **dst = sort->tmp;
+    for(size_t width = 1; width < sort->count; width *= 2) {
+        for(size_t lo = 0; lo < sort->count; lo += 2 * width) {
+            size_t mid = lo + width < sort->count ? lo + width : sort->count;
+            size_t hi  = lo + 2 * width < sort->count ? lo + 2 * width : sort->count;
+            size_t i = lo, j = mid, k = lo;
+            while(i < mid && j < hi) {
+                dst[k++] = _yue_sort_before(ctx, sort, src[j], src[i]) ? src[j++] : src[i++];
             }
-            yue_Object *r = yue_read(ctx, source);
-            yue_Object *curr = yue_pair(ctx, r, yue_nil(ctx));
-            prev->as_pair.tail = curr;
-            prev = curr;
+            while(i < mid) dst[k++] = src[i++];
+            while(j < hi) dst[k++] = src[j++];
         }
+        yue_Object **swap = src;
+        src = dst;
+        dst = swap;
+    }
+    sort->items = src;
+    sort->tmp   = dst;
+    return NULL;
+}
+
+// (sort l) or (sort l before)
+// A new list sorted by number or by string, or by (before a b) which returns
+// non-nil when a goes before b. Equal elements keep their order.
+yue_Object *yue_builtin_sort(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *list = _yue_expect_list(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "sort");
+    yue_pushgc(ctx, list);
+    yue_Sort sort = {0};
+    if(arg->type == YUE_OBJECT_PAIR) {
+        sort.cmp = yue_eval(ctx, yue_nextarg(ctx, &arg));
+        yue_pushgc(ctx, sort.cmp);
+        if(!_yue_callable(sort.cmp)) 
+            yue_error(ctx, "`sort` requires a function but found %s", _yue_type_names[sort.cmp->type]);
+    }
+
+    size_t count_numbers = 0, count_strings = 0;
+    for(yue_Object *it = list; it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) {
+        sort.count += 1;
+        if(it->as_pair.head->type == YUE_OBJECT_NUMBER) count_numbers += 1;
+        if(it->as_pair.head->type == YUE_OBJECT_STRING) count_strings += 1;
+    }
+    sort.strings = count_strings == sort.count;
+    if(!sort.cmp && count_numbers != sort.count && !sort.strings)
+        yue_error(ctx, "`sort` without a function requires only numbers or only strings");
+    if(sort.count < 2) {
         yue_restoregc(ctx, gc);
-        yue_pushgc(ctx, root);
-        return root;
-    } else {
-        size_t i = 0;
-        char name[YUE_STRING_DATA_SIZE] = {0};
-        memset(name, 0, YUE_STRING_DATA_SIZE);
-        while(source->ptr < source->eof) {
-            if(_isspace(*source->ptr)) break;
-            if(*source->ptr == '(' || *source->ptr == ')') break;
-            if(i + 1 >= YUE_STRING_DATA_SIZE) yue_error(ctx, "symbol name is too long");
-            name[i] = *source->ptr;
-            i++;
-            source->ptr++;
-        }
-        name[YUE_STRING_DATA_SIZE-1] = 0;
-        return yue_symbol(ctx, name);
+        return list;
     }
 
-    return yue_nil(ctx);
+    sort.items = malloc(sort.count * sizeof(yue_Object*));
+    sort.tmp   = malloc(sort.count * sizeof(yue_Object*));
+    if(!sort.items || !sort.tmp) {
+        free(sort.items);
+        free(sort.tmp);
+        yue_error(ctx, "Could not allocate room to sort %zu elements", sort.count);
+    }
+    size_t i = 0;
+    for(yue_Object *it = list; it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) sort.items[i++] = it->as_pair.head;
+
+    // the elements stay reachable from list, the arrays are freed even when the comparator raises
+    yue_Status status = _yue_protect(ctx, _yue_sort_items, &sort, NULL);
+    yue_Object *res = yue_nil(ctx);
+    if(status == YUE_OK) {
+        size_t top = yue_savegc(ctx);
+        for(size_t i = sort.count; i-- > 0;) {
+            res = yue_pair(ctx, sort.items[i], res);
+            yue_restoregc(ctx, top);
+            yue_pushgc(ctx, res);
+        }
+    }
+    free(sort.items);
+    free(sort.tmp);
+    if(status != YUE_OK) _yue_throw(ctx, status);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
 }
 
+/////////////////////////
+///
+/// Memoization
+///
+
+#ifndef YUE_MEMO_CAP
+#define YUE_MEMO_CAP 256
+#endif
+
+#define YUE_MEMO_NONE SIZE_MAX
+
+typedef struct yue_MemoEntry {
+    yue_Object *args;
+    yue_Object *value;
+    size_t hash;
+    // next entry of the same bucket
+    size_t next;
+    // set on every hit, cleared when the clock hand passes by
+    bool referenced;
+} yue_MemoEntry;
+
+struct yue_Memo {
+    yue_Object *fn;
+    size_t capacity;
+    size_t count;
+    size_t hand;
+    size_t hits;
+    size_t misses;
+    size_t *buckets;
+    size_t count_buckets;
+    yue_MemoEntry entries[];
+};
+
+static void _yue_memo_mark(yue_Context *ctx, yue_Memo *memo)
+{
+    mark(ctx, memo->fn);
+    for(size_t i = 0; i < memo->count; ++i) {
+        mark(ctx, memo->entries[i].args);
+        mark(ctx, memo->entries[i].value);
+    }
+}
+
+static void _yue_memo_free(yue_Memo *memo)
+{
+    free(memo->buckets);
+    free(memo);
+}
+
+static uint64_t _yue_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Arguments are hashed by value for numbers, strings and symbols and by identity otherwise
+static size_t _yue_memo_hash(yue_Object *args)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for(; args->type == YUE_OBJECT_PAIR; args = args->as_pair.tail) {
+        yue_Object *value = args->as_pair.head;
+        uint64_t x = value->type;
+        switch(value->type) {
+        case YUE_OBJECT_NIL:
+            break;
+        case YUE_OBJECT_NUMBER:
+            {
+                // 0 and -0 are equal
+                yue_Number number = value->as_number == 0 ? 0 : value->as_number;
+                memcpy(&x, &number, sizeof(x));
+            } break;
+        case YUE_OBJECT_STRING:
+            for(yue_Object *curr = value; curr; curr = curr->as_str.tail) {
+                for(size_t i = 0; i < YUE_STRING_DATA_SIZE && curr->as_str.data[i]; ++i) {
+                    x = (x ^ (unsigned char)curr->as_str.data[i]) * 1099511628211ULL;
+                }
+            }
+            break;
+        case YUE_OBJECT_SYMBOL:
+            for(const char *c = value->as_symbol.name; *c; ++c) x = (x ^ (unsigned char)*c) * 1099511628211ULL;
+            break;
+        default:
+            x = (uintptr_t)value;
+            break;
+        }
+        hash = (hash ^ _yue_mix(x)) * 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+static bool _yue_memo_same(yue_Object *a, yue_Object *b)
+{
+    while(a->type == YUE_OBJECT_PAIR && b->type == YUE_OBJECT_PAIR) {
+        yue_Object *x = a->as_pair.head;
+        yue_Object *y = b->as_pair.head;
+        // exact, unlike eq, so that equal arguments always hash the same
+        if(x->type == YUE_OBJECT_NUMBER && y->type == YUE_OBJECT_NUMBER) {
+            if(x->as_number != y->as_number) return false;
+        } else if(!_yue_equal(x, y)) {
+            return false;
+        }
+        a = a->as_pair.tail;
+        b = b->as_pair.tail;
+    }
+    return a->type != YUE_OBJECT_PAIR && b->type != YUE_OBJECT_PAIR;
+}
+
+static void _yue_memo_unlink(yue_Memo *memo, size_t index)
+{
+    size_t *link = &memo->buckets[memo->entries[index].hash & (memo->count_buckets - 1)];
+    while(*link != index) link = &memo->entries[*link].next;
+    *link = memo->entries[index].next;
+}
+
+// A free entry, or the first one the clock hand finds that wasn't used since it last passed
+static size_t _yue_memo_evict(yue_Memo *memo)
+{
+    if(memo->count < memo->capacity) return memo->count++;
+    while(memo->entries[memo->hand].referenced) {
+        memo->entries[memo->hand].referenced = false;
+        memo->hand = (memo->hand + 1) % memo->capacity;
+    }
+    size_t index = memo->hand;
+    memo->hand = (memo->hand + 1) % memo->capacity;
+    _yue_memo_unlink(memo, index);
+    return index;
+}
+
+static yue_Object *_yue_memo_call(yue_Context *ctx, yue_Object *obj, yue_Object *args)
+{
+    yue_Memo *memo = obj->as_memo;
+    // the caller's memos are read-only for pmap workers
+    if(!_yue_owns(ctx, obj)) return yue_call(ctx, memo->fn, args);
+
+    size_t hash = _yue_memo_hash(args);
+    size_t bucket = hash & (memo->count_buckets - 1);
+    for(size_t i = memo->buckets[bucket]; i != YUE_MEMO_NONE; i = memo->entries[i].next) {
+        yue_MemoEntry *entry = &memo->entries[i];
+        if(entry->hash == hash && _yue_memo_same(entry->args, args)) {
+            entry->referenced = true;
+            memo->hits += 1;
+            yue_pushgc(ctx, entry->value);
+            return entry->value;
+        }
+    }
+
+    memo->misses += 1;
+    size_t gc = yue_savegc(ctx);
+    yue_pushgc(ctx, obj);
+    yue_pushgc(ctx, args);
+    yue_Object *value = yue_call(ctx, memo->fn, args);
+    // recursive calls may have added entries in the meantime
+    size_t index = _yue_memo_evict(memo);
+    memo->entries[index] = (yue_MemoEntry){
+        .args  = args,
+        .value = value,
+        .hash  = hash,
+        .next  = memo->buckets[bucket],
+    };
+    memo->buckets[bucket] = index;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, value);
+    return value;
+}
+
+// (memo fn) or (memo fn capacity)
+// fn with its results cached by argument values, at most capacity of them
+yue_Object *yue_builtin_memo(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    if(!_yue_callable(fn)) yue_error(ctx, "`memo` requires a function but found %s", _yue_type_names[fn->type]);
+    size_t capacity = YUE_MEMO_CAP;
+    if(arg->type == YUE_OBJECT_PAIR) {
+        yue_Object *cap = yue_eval(ctx, yue_nextarg(ctx, &arg));
+        if(cap->type != YUE_OBJECT_NUMBER || cap->as_number < 1) yue_error(ctx, "`memo` requires a positive capacity");
+        capacity = (size_t)cap->as_number;
+    }
+    size_t count_buckets = 1;
+    while(count_buckets < capacity * 2) count_buckets *= 2;
+
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_MEMO);
+    obj->as_memo = calloc(1, sizeof(yue_Memo) + capacity * sizeof(yue_MemoEntry));
+    if(obj->as_memo) obj->as_memo->buckets = malloc(count_buckets * sizeof(size_t));
+    if(!obj->as_memo || !obj->as_memo->buckets) {
+        free(obj->as_memo);
+        obj->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not allocate a cache of %zu entries", capacity);
+    }
+    yue_Memo *memo = obj->as_memo;
+    memo->fn            = fn;
+    memo->capacity      = capacity;
+    memo->count_buckets = count_buckets;
+    for(size_t i = 0; i < count_buckets; ++i) memo->buckets[i] = YUE_MEMO_NONE;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// (memo-stats m), a list of hits, misses, cached entries and capacity
+yue_Object *yue_builtin_memo_stats(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    if(obj->type != YUE_OBJECT_MEMO) yue_error(ctx, "`memo-stats` requires a memo but found %s", _yue_type_names[obj->type]);
+    yue_Memo *memo = obj->as_memo;
+    yue_Object *stats[4] = {
+        yue_number(ctx, (yue_Number)memo->hits),
+        yue_number(ctx, (yue_Number)memo->misses),
+        yue_number(ctx, (yue_Number)memo->count),
+        yue_number(ctx, (yue_Number)memo->capacity),
+    };
+    yue_Object *res = yue_list(ctx, stats, 4);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+/////////////////////////
+///
+/// Records
+///
+
+static void _yue_record_mark(yue_Context *ctx, yue_Record *record)
+{
+    for(size_t i = 0; i < record->count; ++i) mark(ctx, record->slots[i]);
+}
+
+static yue_Object *_yue_record_open(yue_Context *ctx, yue_RecordKind kind, yue_Object *type, size_t count)
+{
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_RECORD);
+    obj->as_record = malloc(sizeof(yue_Record) + count * sizeof(yue_Object*));
+    if(!obj->as_record) {
+        obj->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not allocate a record of %zu fields", count);
+    }
+    yue_Record *record = obj->as_record;
+    record->kind  = kind;
+    record->type  = type;
+    record->index = 0;
+    record->count = count;
+    for(size_t i = 0; i < count; ++i) record->slots[i] = yue_nil(ctx);
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+bool yue_isrecord(yue_Object *obj, yue_Object *type)
+{
+    return obj->type == YUE_OBJECT_RECORD && obj->as_record->kind == YUE_RECORD_INSTANCE && obj->as_record->type == type;
+}
+
+// The instance an accessor of field index was called with
+static yue_Record *_yue_expect_record(yue_Context *ctx, yue_Object *obj, yue_Object *type, size_t index)
+{
+    if(!yue_isrecord(obj, type)) {
+        const char *name = type->as_record->type->as_symbol.name;
+        yue_error(ctx, "`%s-%s` requires a %s record but found %s", name, type->as_record->slots[index]->as_symbol.name, 
+                name, _yue_type_names[obj->type]);
+    }
+    return obj->as_record;
+}
+
+yue_Object *yue_record_type(yue_Context *ctx, const char *name, const char **fields, size_t count)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *type = _yue_record_open(ctx, YUE_RECORD_TYPE, yue_symbol(ctx, name), count);
+    for(size_t i = 0; i < count; ++i) type->as_record->slots[i] = yue_symbol(ctx, fields[i]);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, type);
+    return type;
+}
+
+yue_Object *yue_record(yue_Context *ctx, yue_Object *type, yue_Object **values)
+{
+    if(type->type != YUE_OBJECT_RECORD || type->as_record->kind != YUE_RECORD_TYPE) 
+        yue_error(ctx, "Expected a record type but found %s", _yue_type_names[type->type]);
+    yue_Object *obj = _yue_record_open(ctx, YUE_RECORD_INSTANCE, type, type->as_record->count);
+    for(size_t i = 0; i < type->as_record->count; ++i) obj->as_record->slots[i] = values[i];
+    return obj;
+}
+
+size_t yue_record_field(yue_Context *ctx, yue_Object *type, const char *name)
+{
+    if(type->type != YUE_OBJECT_RECORD || type->as_record->kind != YUE_RECORD_TYPE) 
+        yue_error(ctx, "Expected a record type but found %s", _yue_type_names[type->type]);
+    for(size_t i = 0; i < type->as_record->count; ++i) {
+        if(strcmp(type->as_record->slots[i]->as_symbol.name, name) == 0) return i;
+    }
+    yue_error(ctx, "Record %s has no field %s", type->as_record->type->as_symbol.name, name);
+    return 0;
+}
+
+yue_Object *yue_record_get(yue_Context *ctx, yue_Object *record, size_t index)
+{
+    if(record->type != YUE_OBJECT_RECORD || record->as_record->kind != YUE_RECORD_INSTANCE) 
+        yue_error(ctx, "Expected a record but found %s", _yue_type_names[record->type]);
+    if(index >= record->as_record->count) yue_error(ctx, "Record field %zu out of range", index);
+    return record->as_record->slots[index];
+}
+
+void yue_record_set(yue_Context *ctx, yue_Object *record, size_t index, yue_Object *value)
+{
+    if(record->type != YUE_OBJECT_RECORD || record->as_record->kind != YUE_RECORD_INSTANCE) 
+        yue_error(ctx, "Expected a record but found %s", _yue_type_names[record->type]);
+    if(index >= record->as_record->count) yue_error(ctx, "Record field %zu out of range", index);
+    record->as_record->slots[index] = value;
+}
+
+// Calls a record type or accessor, when eval is set args are not evaluated yet.
+// Accessors evaluate their arguments one by one instead of building a list
+static yue_Object *_yue_record_call(yue_Context *ctx, yue_Object *fn, yue_Object *args, bool eval)
+{
+    yue_Record *callee = fn->as_record;
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = NULL;
+    switch(callee->kind) {
+    case YUE_RECORD_TYPE:
+        {
+            if(eval) args = _eval_list(ctx, args);
+            res = _yue_record_open(ctx, YUE_RECORD_INSTANCE, fn, callee->count);
+            for(size_t i = 0; i < callee->count; ++i) {
+                if(args->type != YUE_OBJECT_PAIR) 
+                    yue_error(ctx, "`%s` requires %zu fields", callee->type->as_symbol.name, callee->count);
+                res->as_record->slots[i] = yue_nextarg(ctx, &args);
+            }
+        } break;
+    case YUE_RECORD_PREDICATE:
+        {
+            yue_Object *obj = yue_nextarg(ctx, &args);
+            if(eval) obj = yue_eval(ctx, obj);
+            res = yue_isrecord(obj, callee->type) ? obj : yue_nil(ctx);
+        } break;
+    case YUE_RECORD_GETTER:
+        {
+            yue_Object *obj = yue_nextarg(ctx, &args);
+            if(eval) obj = yue_eval(ctx, obj);
+            res = _yue_expect_record(ctx, obj, callee->type, callee->index)->slots[callee->index];
+        } break;
+    case YUE_RECORD_SETTER:
+        {
+            yue_Object *obj = yue_nextarg(ctx, &args);
+            if(eval) obj = yue_eval(ctx, obj);
+            if(eval) yue_pushgc(ctx, obj);
+            yue_Object *value = yue_nextarg(ctx, &args);
+            if(eval) value = yue_eval(ctx, value);
+            yue_Record *record = _yue_expect_record(ctx, obj, callee->type, callee->index);
+            // records of the caller are read only in pmap workers, their heap goes away with the worker
+            if(!_yue_owns(ctx, obj)) {
+                yue_error(ctx, "`set-%s-%s` can't change a record of another context", 
+                        callee->type->as_record->type->as_symbol.name,
+                        callee->type->as_record->slots[callee->index]->as_symbol.name);
+            }
+            record->slots[callee->index] = value;
+            res = value;
+        } break;
+    case YUE_RECORD_INSTANCE:
+        yue_error(ctx, "Invoking non callable object %s", _yue_type_names[fn->type]);
+        break;
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+static void _yue_record_define(yue_Context *ctx, const char *prefix, const char *name, const char *suffix, yue_Object *value)
+{
+    // names that don't fit are reported by yue_symbol
+    char buf[2 * YUE_STRING_DATA_SIZE + 8];
+    snprintf(buf, sizeof(buf), "%s%s%s", prefix, name, suffix);
+    yue_set(ctx, yue_symbol(ctx, buf), value);
+}
+
+// (defrecord point x y)
+// binds the type `point`, (point x y) makes an instance, (point? obj) checks for one,
+// (point-x p) reads a field and (set-point-x p value) writes it
+yue_Object *yue_builtin_defrecord(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *name = yue_nextarg(ctx, &arg);
+    if(name->type != YUE_OBJECT_SYMBOL) yue_error(ctx, "`defrecord` requires a name but found %s", _yue_type_names[name->type]);
+    size_t count = 0;
+    for(yue_Object *field = arg; field->type == YUE_OBJECT_PAIR; field = field->as_pair.tail) {
+        if(field->as_pair.head->type != YUE_OBJECT_SYMBOL) 
+            yue_error(ctx, "`defrecord` field is not a symbol but %s", _yue_type_names[field->as_pair.head->type]);
+        count += 1;
+    }
+    yue_Object *type = _yue_record_open(ctx, YUE_RECORD_TYPE, name, count);
+    for(size_t i = 0; i < count; ++i) type->as_record->slots[i] = yue_nextarg(ctx, &arg);
+
+    const char *type_name = name->as_symbol.name;
+    yue_set(ctx, name, type);
+    _yue_record_define(ctx, "", type_name, "?", _yue_record_open(ctx, YUE_RECORD_PREDICATE, type, 0));
+    for(size_t i = 0; i < count; ++i) {
+        char field[YUE_STRING_DATA_SIZE + 1];
+        snprintf(field, sizeof(field), "-%s", type->as_record->slots[i]->as_symbol.name);
+        yue_Object *getter = _yue_record_open(ctx, YUE_RECORD_GETTER, type, 0);
+        getter->as_record->index = i;
+        _yue_record_define(ctx, "", type_name, field, getter);
+        yue_Object *setter = _yue_record_open(ctx, YUE_RECORD_SETTER, type, 0);
+        setter->as_record->index = i;
+        _yue_record_define(ctx, "set-", type_name, field, setter);
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, type);
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, type);
+    return type;
+}
+
+/////////////////////////
+///
+/// Natives
+///
+
+static bool _yue_native_type(char type, bool result)
+{
+    return strchr("ifbsuo", type) != NULL || (result && type == 'v');
+}
+
+// Converts an argument of any type but 's'
+static void _yue_native_value(yue_Context *ctx, const yue_Native *native, char type, yue_Object *obj, yue_Value *dst)
+{
+    switch(type) {
+    case 'i':
+    case 'f':
+        if(obj->type != YUE_OBJECT_NUMBER) {
+            yue_error(ctx, "`%s` requires a number but found %s", native->name, _yue_type_names[obj->type]);
+        }
+        if(type == 'i') {
+            dst->i = (long)obj->as_number;
+        } else {
+            dst->f = obj->as_number;
+        }
+        break;
+    case 'b':
+        dst->b = obj->type != YUE_OBJECT_NIL;
+        break;
+    case 'u':
+        if(obj->type != YUE_OBJECT_USERDATA) {
+            yue_error(ctx, "`%s` requires a userdata but found %s", native->name, _yue_type_names[obj->type]);
+        }
+        dst->u = obj->as_userdata;
+        break;
+    default:
+        dst->o = obj;
+        break;
+    }
+}
+
+// Copies a string argument into dst, one that doesn't fit is an error rather than cut
+static const char *_yue_native_string(yue_Context *ctx, const yue_Native *native, yue_Object *obj, char *dst, size_t dstsz)
+{
+    if(obj->type != YUE_OBJECT_STRING) {
+        yue_error(ctx, "`%s` requires a string but found %s", native->name, _yue_type_names[obj->type]);
+    }
+    if(yue_getstringlen(ctx, obj) >= dstsz) {
+        yue_error(ctx, "The strings passed to `%s` are longer than %d bytes", native->name, YUE_NATIVE_STRINGS - 1);
+    }
+    return yue_tostring(ctx, obj, dst, dstsz);
+}
+
+static yue_Object *_yue_native(yue_Context *ctx, const yue_Native *native)
+{
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_NATIVE);
+    obj->as_native = native;
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// Converts the arguments by the signature, args are evaluated first unless they're values already
+static yue_Object *_yue_native_call(yue_Context *ctx, yue_Object *fn, yue_Object *args, bool eval)
+{
+    const yue_Native *native = fn->as_native;
+    yue_Value values[YUE_NATIVE_ARGS];
+    // strings are copied one after the other
+    char strings[YUE_NATIVE_STRINGS];
+    size_t used = 0;
+    size_t gc = yue_savegc(ctx);
+    const char *sig = native->signature;
+    for(size_t i = 0; *sig && *sig != '>'; ++sig, ++i) {
+        yue_Object *obj = yue_nextarg(ctx, &args);
+        if(eval) obj = yue_eval(ctx, obj);
+        if(*sig == 's') {
+            values[i].s = _yue_native_string(ctx, native, obj, strings + used, sizeof(strings) - used);
+            used += strlen(values[i].s) + 1;
+        } else {
+            _yue_native_value(ctx, native, *sig, obj, &values[i]);
+        }
+    }
+    yue_Value res = native->fn(ctx, values);
+    yue_restoregc(ctx, gc);
+    // small integers and booleans don't allocate, see yue_number
+    switch(*sig == '>' ? sig[1] : 'v') {
+    case 'i':
+        return yue_number(ctx, (yue_Number)res.i);
+    case 'f':
+        return yue_number(ctx, res.f);
+    case 'b':
+        return res.b ? yue_true(ctx) : ctx->nil;
+    case 's':
+        return res.s ? yue_string(ctx, res.s) : ctx->nil;
+    case 'u':
+        return yue_userdata(ctx, res.u);
+    case 'o':
+        if(!res.o) return ctx->nil;
+        yue_pushgc(ctx, res.o);
+        return res.o;
+    default:
+        return ctx->nil;
+    }
+}
+
+yue_Object *yue_true(yue_Context *ctx)
+{
+    return &ctx->numbers[1];
+}
+
+static void _yue_native_check(yue_Context *ctx, const yue_Native *native)
+{
+    const char *sig = native->signature;
+    size_t count_args = 0;
+    while(*sig && *sig != '>' && _yue_native_type(*sig, false)) ++sig, ++count_args;
+    bool valid = *sig == 0 || (sig[0] == '>' && _yue_native_type(sig[1], true) && sig[2] == 0);
+    if(!valid) yue_error(ctx, "Invalid signature \"%s\" of `%s`", native->signature, native->name);
+    if(count_args > YUE_NATIVE_ARGS) yue_error(ctx, "`%s` has more than %d arguments", native->name, YUE_NATIVE_ARGS);
+}
+
+void yue_register(yue_Context *ctx, const yue_Native *natives, size_t count)
+{
+    size_t gc = yue_savegc(ctx);
+    for(size_t i = 0; i < count; ++i) {
+        const yue_Native *native = &natives[i];
+        _yue_native_check(ctx, native);
+        yue_set(ctx, yue_symbol(ctx, native->name), _yue_native(ctx, native));
+    }
+    yue_restoregc(ctx, gc);
+}
+
+void yue_register_plugin(yue_Context *ctx, const yue_Plugin *plugin)
+{
+    if(!ctx->plugins) ctx->plugins = ctx->nil;
+    for(yue_Object *it = ctx->plugins; it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) {
+        if(it->as_pair.head->as_userdata == plugin) return;
+    }
+    size_t gc = yue_savegc(ctx);
+    ctx->plugins = yue_pair(ctx, yue_userdata(ctx, (void*)plugin), ctx->plugins);
+    yue_restoregc(ctx, gc);
+}
+
+// Binds an export of the registered plugins as a global, NULL when none has this name
+static yue_Object *_yue_plugin_get(yue_Context *ctx, const char *name)
+{
+    yue_Object *value = NULL;
+    for(yue_Object *it = ctx->plugins; !value && it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) {
+        const yue_Plugin *plugin = it->as_pair.head->as_userdata;
+        for(size_t i = 0; !value && i < plugin->count_natives; ++i) {
+            const yue_Native *native = &plugin->natives[i];
+            if(strcmp(native->name, name) != 0) continue;
+            _yue_native_check(ctx, native);
+            value = _yue_native(ctx, native);
+        }
+        for(size_t i = 0; !value && i < plugin->count_constants; ++i) {
+            if(strcmp(plugin->constants[i].name, name) == 0) value = yue_number(ctx, plugin->constants[i].value);
+        }
+    }
+    if(!value) return NULL;
+    _yue_bind_global(ctx, name, value);
+    return value;
+}
+
+/////////////////////////
+///
+/// Modules
+///
+
+static void _yue_module_mark(yue_Context *ctx, yue_Module *module)
+{
+    for(yue_Object *sym = module->bindings; sym; sym = sym->next) mark(ctx, sym);
+    if(module->next) mark(ctx, module->next);
+}
+
+static bool _yue_module_path(yue_Context *ctx, const char *name, char *path, size_t pathsz)
+{
+    char joined[YUE_PATH_CAP];
+    bool absolute = name[0] == '/' || name[0] == '\\' || (name[0] && name[1] == ':');
+    const char *dir = ctx->module ? ctx->module->as_module->path : NULL;
+    const char *slash = dir ? strrchr(dir, '/') : NULL;
+#if defined(_WIN32)
+    const char *backslash = dir ? strrchr(dir, '\\') : NULL;
+    if(backslash > slash) slash = backslash;
+#endif
+    int len;
+    if(!absolute && slash) {
+        len = snprintf(joined, sizeof(joined), "%.*s/%s", (int)(slash - dir), dir, name);
+    } else {
+        len = snprintf(joined, sizeof(joined), "%s", name);
+    }
+    if(len < 0 || (size_t)len >= sizeof(joined)) yue_error(ctx, "Module path too long: '%s'", name);
+#if defined(_WIN32)
+    if(!_fullpath(path, joined, pathsz)) return false;
+    return GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES;
+#else
+    char *resolved = realpath(joined, NULL);
+    if(!resolved) return false;
+    len = snprintf(path, pathsz, "%s", resolved);
+    free(resolved);
+    if(len < 0 || (size_t)len >= pathsz) yue_error(ctx, "Module path too long: '%s'", name);
+    return true;
+#endif
+}
+
+typedef struct {
+    yue_Object *module;
+    char *text;
+} yue_ModuleLoad;
+
+static yue_Object *_yue_module_body(yue_Context *ctx, void *arg)
+{
+    yue_ModuleLoad *load = arg;
+    yue_Module *module = load->module->as_module;
+    FILE *f = fopen(module->path, "rb");
+    if(!f) yue_error(ctx, "Could not open module '%s'", module->path);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    // the reader expects a terminated text
+    load->text = malloc(size > 0 ? size + 1 : 1);
+    size_t count = load->text ? fread(load->text, 1, size > 0 ? size : 0, f) : 0;
+    fclose(f);
+    if(!load->text) yue_error(ctx, "Could not read module '%s'", module->path);
+    load->text[count] = 0;
+
+    _yue_module_enter(ctx, load->module);
+    yue_File file = {load->text, load->text, load->text + count};
+    size_t gc = yue_savegc(ctx);
+    for(;;) {
+        yue_restoregc(ctx, gc);
+        yue_Object *form = yue_read(ctx, &file);
+        if(yue_isnil(form)) break;
+        yue_eval(ctx, form);
+        // top-level `=` binds in the module's scope
+        module->bindings = ctx->scope[ctx->module_scope];
+    }
+    yue_restoregc(ctx, gc);
+    end_scope(ctx);
+    return ctx->nil;
+}
+
+// Parses and evaluates a module, its code runs in a scope of its own
+static void _yue_module_load(yue_Context *ctx, yue_Object *obj)
+{
+    yue_Module *module = obj->as_module;
+    if(module->state == YUE_MODULE_LOADING) yue_error(ctx, "Module '%s' is used while it's loading", module->path);
+    module->state = YUE_MODULE_LOADING;
+    yue_ModuleLoad load = {obj, NULL};
+    yue_Object *running = ctx->module;
+    size_t running_scope = ctx->module_scope;
+    yue_Status status = _yue_protect(ctx, _yue_module_body, &load, NULL);
+    ctx->module       = running;
+    ctx->module_scope = running_scope;
+    free(load.text);
+    if(status != YUE_OK) {
+        module->state    = YUE_MODULE_UNLOADED;
+        module->bindings = NULL;
+        _yue_throw(ctx, status);
+    }
+    module->state = YUE_MODULE_LOADED;
+}
+
+// `name/binding` when name is bound to a module, nil otherwise
+static yue_Object *_yue_module_get(yue_Context *ctx, const char *name)
+{
+    const char *slash = strchr(name, '/');
+    if(!slash || slash == name || slash[1] == 0) return ctx->nil;
+    char prefix[YUE_STRING_DATA_SIZE];
+    snprintf(prefix, sizeof(prefix), "%.*s", (int)(slash - name), name);
+    yue_Object *binding = _yue_lookup(ctx, prefix);
+    if(!binding || binding->as_symbol.value->type != YUE_OBJECT_MODULE) return ctx->nil;
+    yue_Object *obj = binding->as_symbol.value;
+    if(obj->as_module->state != YUE_MODULE_LOADED) {
+        // workers of pmap only read the caller's modules
+        if(!_yue_owns(ctx, obj)) yue_error(ctx, "Module '%s' is used by a worker before it's loaded", obj->as_module->path);
+        _yue_module_load(ctx, obj);
+    }
+    for(yue_Object *sym = obj->as_module->bindings; sym; sym = sym->next) {
+        if(strcmp(sym->as_symbol.name, slash + 1) == 0) return sym->as_symbol.value;
+    }
+    return ctx->nil;
+}
+
+// (require path), the module of a .yue file. It's loaded when it's first used
+yue_Object *yue_builtin_require(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(obj->type != YUE_OBJECT_STRING) yue_error(ctx, "`require` requires a path but found %s", _yue_type_names[obj->type]);
+    char name[YUE_PATH_CAP];
+    char path[YUE_PATH_CAP];
+    yue_tostring(ctx, obj, name, sizeof(name));
+    if(strlen(name) + 1 >= sizeof(name)) yue_error(ctx, "Module path too long: '%.64s...'", name);
+    if(!_yue_module_path(ctx, name, path, sizeof(path))) yue_error(ctx, "Could not find module '%s'", name);
+    yue_restoregc(ctx, gc);
+
+    for(yue_Object *module = ctx->modules; module; module = module->as_module->next) {
+        if(strcmp(module->as_module->path, path) == 0) return module;
+    }
+    size_t len = strlen(path) + 1;
+    yue_Object *module = new_object(ctx, YUE_OBJECT_MODULE);
+    module->as_module = malloc(sizeof(yue_Module) + len);
+    if(!module->as_module) {
+        module->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not allocate module '%s'", path);
+    }
+    module->as_module->next     = ctx->modules;
+    module->as_module->bindings = NULL;
+    module->as_module->state    = YUE_MODULE_UNLOADED;
+    memcpy(module->as_module->path, path, len);
+    ctx->modules = module;
+    yue_pushgc(ctx, module);
+    return module;
+}
+
+/////////////////////////
+///
+/// Batches
+///
+
+typedef struct {
+    const yue_Native *native;
+    // index of the first argument in values
+    size_t first;
+    size_t count_args;
+    bool strings;
+} yue_BatchCommand;
+
+struct yue_Batch {
+    yue_BatchCommand *commands;
+    size_t count_commands;
+    size_t cap_commands;
+    // string arguments hold their offset in strings until the batch runs
+    yue_Value *values;
+    size_t count_values;
+    size_t cap_values;
+    char *strings;
+    size_t count_strings;
+    size_t cap_strings;
+    // the arguments of a run with strings, resolved
+    yue_Value *scratch;
+    size_t cap_scratch;
+    bool running;
+};
+
+static void _yue_batch_mark(yue_Context *ctx, yue_Batch *batch)
+{
+    for(size_t i = 0; i < batch->count_commands; ++i) {
+        const yue_BatchCommand *cmd = &batch->commands[i];
+        for(size_t j = 0; j < cmd->count_args; ++j) {
+            if(cmd->native->signature[j] == 'o') mark(ctx, batch->values[cmd->first + j].o);
+        }
+    }
+}
+
+static void _yue_batch_free(yue_Batch *batch)
+{
+    free(batch->commands);
+    free(batch->values);
+    free(batch->strings);
+    free(batch->scratch);
+    free(batch);
+}
+
+// Makes room for count more items, the array keeps its items when it can't grow
+static void *_yue_batch_reserve(yue_Context *ctx, void *items, size_t *cap, size_t used, size_t count, size_t size)
+{
+    if(used + count <= *cap) return items;
+    size_t new_cap = *cap ? *cap : 64;
+    while(new_cap < used + count) new_cap *= 2;
+    void *res = realloc(items, new_cap * size);
+    if(!res) yue_error(ctx, "Could not grow a batch to %zu items", new_cap);
+    *cap = new_cap;
+    return res;
+}
+
+static yue_Object *_yue_batch_arg(yue_Context *ctx, const char *name, yue_Object **arg)
+{
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, arg));
+    yue_pushgc(ctx, obj);
+    if(obj->type != YUE_OBJECT_BATCH) yue_error(ctx, "`%s` requires a batch but found %s", name, _yue_type_names[obj->type]);
+    if(obj->as_batch->running) yue_error(ctx, "`%s` can't change a batch while it runs", name);
+    if(!_yue_owns(ctx, obj)) yue_error(ctx, "`%s` can't change a batch of another context", name);
+    return obj;
+}
+
+// The arguments of count commands starting at cmd, with the offsets of strings replaced by pointers
+static const yue_Value *_yue_batch_args(yue_Context *ctx, yue_Batch *batch, const yue_BatchCommand *cmd, size_t count)
+{
+    const yue_Value *values = &batch->values[cmd->first];
+    if(!cmd->strings) return values;
+    size_t count_values = count * cmd->count_args;
+    batch->scratch = _yue_batch_reserve(ctx, batch->scratch, &batch->cap_scratch, 0, count_values, sizeof(yue_Value));
+    for(size_t i = 0; i < count_values; ++i) {
+        batch->scratch[i] = values[i];
+        if(cmd->native->signature[i % cmd->count_args] == 's') batch->scratch[i].s = batch->strings + values[i].i;
+    }
+    return batch->scratch;
+}
+
+static yue_Object *_yue_batch_commands(yue_Context *ctx, void *arg)
+{
+    yue_Batch *batch = arg;
+    size_t gc = yue_savegc(ctx);
+    for(size_t i = 0; i < batch->count_commands;) {
+        const yue_BatchCommand *cmd = &batch->commands[i];
+        const yue_Native *native = cmd->native;
+        size_t count = 1;
+        if(native->batch) {
+            while(i + count < batch->count_commands && batch->commands[i + count].native == native) ++count;
+            native->batch(ctx, _yue_batch_args(ctx, batch, cmd, count), count);
+        } else {
+            native->fn(ctx, _yue_batch_args(ctx, batch, cmd, 1));
+        }
+        yue_restoregc(ctx, gc);
+        i += count;
+    }
+    return ctx->nil;
+}
+
+// (batch), an empty command buffer
+yue_Object *yue_builtin_batch(yue_Context *ctx, yue_Object *arg)
+{
+    (void)arg;
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_BATCH);
+    obj->as_batch = calloc(1, sizeof(yue_Batch));
+    if(!obj->as_batch) {
+        obj->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not allocate a batch");
+    }
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// (batch-add b fn args...) appends a call of the native fn, returns b
+yue_Object *yue_builtin_batch_add(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = _yue_batch_arg(ctx, "batch-add", &arg);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    if(fn->type != YUE_OBJECT_NATIVE) yue_error(ctx, "`batch-add` requires a native but found %s", _yue_type_names[fn->type]);
+    const yue_Native *native = fn->as_native;
+
+    // every argument is evaluated before the batch changes, they could add to it too
+    yue_Object *args[YUE_NATIVE_ARGS];
+    size_t count_args = 0;
+    for(const char *sig = native->signature; *sig && *sig != '>'; ++sig) {
+        args[count_args] = yue_eval(ctx, yue_nextarg(ctx, &arg));
+        yue_pushgc(ctx, args[count_args++]);
+    }
+    yue_Batch *batch = obj->as_batch;
+    if(batch->running) yue_error(ctx, "`batch-add` can't change a batch while it runs");
+
+    batch->commands = _yue_batch_reserve(ctx, batch->commands, &batch->cap_commands, batch->count_commands, 1, sizeof(yue_BatchCommand));
+    batch->values   = _yue_batch_reserve(ctx, batch->values, &batch->cap_values, batch->count_values, count_args, sizeof(yue_Value));
+    yue_BatchCommand cmd = {native, batch->count_values, count_args, false};
+    size_t count_strings = batch->count_strings;
+    // the same limit as a call, see _yue_native_call
+    char buf[YUE_NATIVE_STRINGS];
+    size_t used = 0;
+    for(size_t i = 0; i < count_args; ++i) {
+        yue_Value *dst = &batch->values[cmd.first + i];
+        if(native->signature[i] == 's') {
+            const char *text = _yue_native_string(ctx, native, args[i], buf + used, sizeof(buf) - used);
+            size_t len = strlen(text) + 1;
+            used += len;
+            batch->strings = _yue_batch_reserve(ctx, batch->strings, &batch->cap_strings, count_strings, len, 1);
+            memcpy(batch->strings + count_strings, text, len);
+            dst->i = (long)count_strings;
+            count_strings += len;
+            cmd.strings = true;
+        } else {
+            _yue_native_value(ctx, native, native->signature[i], args[i], dst);
+        }
+    }
+    batch->commands[batch->count_commands++] = cmd;
+    batch->count_values += count_args;
+    batch->count_strings = count_strings;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// (batch-run b) calls every command of b in order, returns how many
+yue_Object *yue_builtin_batch_run(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Batch *batch = _yue_batch_arg(ctx, "batch-run", &arg)->as_batch;
+    batch->running = true;
+    // the batch can change again even when a native raises
+    yue_Status status = _yue_protect(ctx, _yue_batch_commands, batch, NULL);
+    batch->running = false;
+    if(status != YUE_OK) _yue_throw(ctx, status);
+    yue_restoregc(ctx, gc);
+    return yue_number(ctx, (yue_Number)batch->count_commands);
+}
+
+// (batch-clear b) removes every command of b, keeping its memory for the next ones
+yue_Object *yue_builtin_batch_clear(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Batch *batch = _yue_batch_arg(ctx, "batch-clear", &arg)->as_batch;
+    batch->count_commands = 0;
+    batch->count_values   = 0;
+    batch->count_strings  = 0;
+    yue_restoregc(ctx, gc);
+    return ctx->nil;
+}
+
+/////////////////////////
+///
+/// Profiler
+///
+
+static void *_yue_profile_grow(yue_Context *ctx, void *items, uint32_t *cap, size_t size)
+{
+    uint32_t new_cap = *cap ? *cap * 2 : 256;
+    void *res = realloc(items, (size_t)new_cap * size);
+    if(!res) yue_error(ctx, "Profiler is out of memory");
+    *cap = new_cap;
+    return res;
+}
+
+// The slot of name in slots, or the empty one where it goes
+static uint32_t _yue_names_slot(char **names, const uint32_t *slots, uint32_t count_slots, const char *name)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for(const char *c = name; *c; ++c) hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    uint32_t mask = count_slots - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while(slots[slot] != YUE_PROFILE_NONE && strcmp(names[slots[slot]], name) != 0) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static bool _yue_names_rehash(yue_Names *names, uint32_t count_slots)
+{
+    uint32_t *slots = malloc(count_slots * sizeof(*slots));
+    if(!slots) return false;
+    for(uint32_t i = 0; i < count_slots; ++i) slots[i] = YUE_PROFILE_NONE;
+    for(uint32_t i = 0; i < names->count_names; ++i) {
+        slots[_yue_names_slot(names->names, slots, count_slots, names->names[i])] = i;
+    }
+    free(names->slots);
+    names->slots       = slots;
+    names->count_slots = count_slots;
+    return true;
+}
+
+// The id of name, YUE_PROFILE_NONE when it's new and there's no memory for it
+static uint32_t _yue_names_add(yue_Names *names, const char *name)
+{
+    if(names->count_slots == 0 && !_yue_names_rehash(names, 256)) return YUE_PROFILE_NONE;
+    uint32_t slot = _yue_names_slot(names->names, names->slots, names->count_slots, name);
+    if(names->slots[slot] != YUE_PROFILE_NONE) return names->slots[slot];
+    // grown before it's more than half full
+    if(names->count_names * 2 + 2 > names->count_slots) {
+        if(!_yue_names_rehash(names, names->count_slots * 2)) return YUE_PROFILE_NONE;
+        slot = _yue_names_slot(names->names, names->slots, names->count_slots, name);
+    }
+
+    if(names->count_names == names->cap_names) {
+        uint32_t cap = names->cap_names ? names->cap_names * 2 : 256;
+        char **grown = realloc(names->names, cap * sizeof(*grown));
+        if(!grown) return YUE_PROFILE_NONE;
+        names->names     = grown;
+        names->cap_names = cap;
+    }
+    size_t len = strlen(name);
+    char *copy = malloc(len + 1);
+    if(!copy) return YUE_PROFILE_NONE;
+    memcpy(copy, name, len + 1);
+    uint32_t id = names->count_names++;
+    names->names[id]   = copy;
+    names->slots[slot] = id;
+    return id;
+}
+
+static uint32_t _yue_names_intern(yue_Context *ctx, yue_Names *names, const char *name)
+{
+    uint32_t id = _yue_names_add(names, name);
+    if(id == YUE_PROFILE_NONE) yue_error(ctx, "Profiler is out of memory");
+    return id;
+}
+
+static void _yue_names_free(yue_Names *names)
+{
+    for(uint32_t i = 0; i < names->count_names; ++i) free(names->names[i]);
+    free(names->names);
+    free(names->slots);
+    *names = (yue_Names){0};
+}
+
+// Top-level forms are named after their file and line
+static void _yue_form_name(const yue_Code *code, size_t line, char *dst, size_t dstsz)
+{
+    snprintf(dst, dstsz, "%.96s:%zu", code->name[0] ? code->name : "<code>", line);
+}
+
+static uint32_t _yue_profile_child(yue_Context *ctx, yue_Profile *prof, uint32_t parent, uint32_t name)
+{
+    for(uint32_t i = prof->nodes[parent].first_child; i != YUE_PROFILE_NONE; i = prof->nodes[i].next_sibling) {
+        if(prof->nodes[i].name == name) return i;
+    }
+    if(prof->count_nodes == prof->cap_nodes) 
+        prof->nodes = _yue_profile_grow(ctx, prof->nodes, &prof->cap_nodes, sizeof(*prof->nodes));
+    uint32_t id = prof->count_nodes++;
+    prof->nodes[id] = (yue_ProfileNode){
+        .parent       = parent,
+        .name         = name,
+        .first_child  = YUE_PROFILE_NONE,
+        .next_sibling = prof->nodes[parent].first_child,
+    };
+    prof->nodes[parent].first_child = id;
+    return id;
+}
+
+// Returns what _yue_profile_leave takes to end the frame
+static size_t _yue_profile_enter(yue_Context *ctx, yue_Profile *prof, const char *name)
+{
+    if(prof->depth >= YUE_PROFILE_DEPTH) {
+        prof->overflow += 1;
+        return SIZE_MAX;
+    }
+    size_t depth = prof->depth;
+    yue_ProfileFrame *frame = &prof->stack[depth];
+    frame->name = _yue_names_intern(ctx, &prof->names, name);
+    if(prof->mode == YUE_PROFILE_INSTRUMENT) {
+        frame->node     = _yue_profile_child(ctx, prof, depth > 0 ? prof->stack[depth - 1].node : 0, frame->name);
+        frame->child_ns = 0;
+        frame->start_ns = _yue_now_ns();
+    }
+    // the frame is complete before the signal handler can see it
+    atomic_signal_fence(memory_order_seq_cst);
+    prof->depth = depth + 1;
+    return depth;
+}
+
+// Ends the frame and every frame above it. Coroutines and tasks switch stacks without 
+// leaving their frames, those are ended by whoever leaves a frame below them
+static void _yue_profile_leave(yue_Profile *prof, size_t frame)
+{
+    if(frame == SIZE_MAX) {
+        if(prof->overflow > 0) prof->overflow -= 1;
+        return;
+    }
+    uint64_t now = prof->mode == YUE_PROFILE_INSTRUMENT ? _yue_now_ns() : 0;
+    while(prof->depth > frame) {
+        size_t depth = prof->depth - 1;
+        prof->depth = depth;
+        if(prof->mode != YUE_PROFILE_INSTRUMENT) continue;
+        yue_ProfileFrame *curr = &prof->stack[depth];
+        yue_ProfileNode *node = &prof->nodes[curr->node];
+        uint64_t elapsed = now - curr->start_ns;
+        node->calls    += 1;
+        node->total_ns += elapsed;
+        node->self_ns  += elapsed - (curr->child_ns < elapsed ? curr->child_ns : elapsed);
+        if(depth > 0) prof->stack[depth - 1].child_ns += elapsed;
+    }
+}
+
+// An error unwound the calls above depth
+static void _yue_profile_unwind(yue_Profile *prof, size_t depth)
+{
+    prof->overflow = 0;
+    _yue_profile_leave(prof, depth);
+}
+
+static yue_Object *_yue_profile_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg)
+{
+    yue_Profile *prof = ctx->profile;
+    const char *name = base->type == YUE_OBJECT_SYMBOL ? base->as_symbol.name : "<anonymous>";
+    size_t frame = _yue_profile_enter(ctx, prof, name);
+    yue_Object *res = _yue_apply(ctx, form, base, fn, arg);
+    // the profile may have been stopped or replaced by the call
+    if(ctx->profile == prof && prof->running) _yue_profile_leave(prof, frame);
+    return res;
+}
+
+typedef struct {
+    yue_Code *code;
+    yue_Object *form;
+    size_t line;
+} yue_ProfileForm;
+
+// Runs a top-level form in a frame named after where it is, errors end the frame
+// when they unwind
+static yue_Object *_yue_profile_form(yue_Context *ctx, void *arg)
+{
+    yue_ProfileForm *form = arg;
+    yue_Profile *prof = ctx->profile;
+    char name[YUE_PROFILE_NAME];
+    _yue_form_name(form->code, form->line, name, sizeof(name));
+    size_t frame = _yue_profile_enter(ctx, prof, name);
+    yue_Object *res = yue_eval(ctx, form->form);
+    if(ctx->profile == prof && prof->running) _yue_profile_leave(prof, frame);
+    return res;
+}
+
+#if !defined(_WIN32)
+// the profile sampled on this thread, SIGPROF has a single handler so only one profile
+// can sample at a time
+static _Thread_local yue_Profile *_yue_sampled;
+static atomic_bool _yue_sampling;
+// signals of a process wide timer that landed on another thread, added to dropped
+static atomic_size_t _yue_sample_misses;
+
+static void _yue_profile_signal(int sig)
+{
+    (void)sig;
+    yue_Profile *prof = _yue_sampled;
+    if(!prof) {
+        if(atomic_load(&_yue_sampling)) atomic_fetch_add(&_yue_sample_misses, 1);
+        return;
+    }
+    if(!prof->running) return;
+    size_t depth = prof->depth;
+    size_t count  = prof->count_samples;
+    if(count + depth + 1 > YUE_PROFILE_SAMPLES) {
+        prof->dropped += 1;
+        return;
+    }
+    prof->samples[count] = (uint32_t)depth;
+    for(size_t i = 0; i < depth; ++i) prof->samples[count + 1 + i] = prof->stack[i].name;
+    prof->count_samples = count + depth + 1;
+}
+#endif
+
+void yue_profile_clear(yue_Context *ctx)
+{
+    yue_Profile *prof = ctx->profile;
+    if(!prof) return;
+    yue_profile_stop(ctx);
+    _yue_names_free(&prof->names);
+    free(prof->nodes);
+    free(prof->samples);
+    free(prof);
+    ctx->profile = NULL;
+}
+
+bool yue_profile_start(yue_Context *ctx, yue_ProfileMode mode)
+{
+    if(ctx->profile && ctx->profile->mode != mode) yue_profile_clear(ctx);
+    yue_Profile *prof = ctx->profile;
+    if(!prof) {
+        prof = calloc(1, sizeof(*prof));
+        if(!prof) return false;
+        prof->mode        = mode;
+        prof->cap_nodes   = 256;
+        prof->nodes       = malloc(prof->cap_nodes * sizeof(*prof->nodes));
+        if(mode == YUE_PROFILE_SAMPLE) prof->samples = malloc(YUE_PROFILE_SAMPLES * sizeof(*prof->samples));
+        if(!prof->nodes || (mode == YUE_PROFILE_SAMPLE && !prof->samples)) {
+            free(prof->nodes);
+            free(prof->samples);
+            free(prof);
+            return false;
+        }
+        prof->count_nodes = 1;
+        prof->nodes[0] = (yue_ProfileNode){
+            .parent       = YUE_PROFILE_NONE,
+            .first_child  = YUE_PROFILE_NONE,
+            .next_sibling = YUE_PROFILE_NONE,
+        };
+        ctx->profile = prof;
+    }
+    if(prof->running) return true;
+    prof->depth    = 0;
+    prof->overflow = 0;
+
+    if(mode == YUE_PROFILE_SAMPLE) {
+#if defined(_WIN32)
+        return false;
+#else
+        if(atomic_exchange(&_yue_sampling, true)) return false;
+        _yue_sampled = prof;
+        atomic_store(&_yue_sample_misses, 0);
+        struct sigaction action = {0};
+        action.sa_handler = _yue_profile_signal;
+        action.sa_flags   = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, NULL);
+#if defined(__linux__)
+        // the signal goes to this thread only, pmap workers and the runner's other
+        // threads are never interrupted
+        struct sigevent event = {0};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo  = SIGPROF;
+#if defined(sigev_notify_thread_id)
+        event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+#else
+        event._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+#endif
+        if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &prof->timer) != 0) {
+            signal(SIGPROF, SIG_IGN);
+            _yue_sampled = NULL;
+            atomic_store(&_yue_sampling, false);
+            return false;
+        }
+        struct itimerspec timer = {
+            .it_interval = {0, YUE_PROFILE_PERIOD * 1000},
+            .it_value    = {0, YUE_PROFILE_PERIOD * 1000},
+        };
+        timer_settime(prof->timer, 0, &timer, NULL);
+#else
+        struct itimerval timer = {
+            .it_interval = {0, YUE_PROFILE_PERIOD},
+            .it_value    = {0, YUE_PROFILE_PERIOD},
+        };
+        setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+#endif
+    }
+    prof->running = true;
+    return true;
+}
+
+void yue_profile_stop(yue_Context *ctx)
+{
+    yue_Profile *prof = ctx->profile;
+    if(!prof || !prof->running) return;
+    // calls still running are counted up to now
+    _yue_profile_leave(prof, 0);
+    prof->running = false;
+#if !defined(_WIN32)
+    if(prof->mode == YUE_PROFILE_SAMPLE) {
+#if defined(__linux__)
+        timer_delete(prof->timer);
+#else
+        struct itimerval timer = {0};
+        setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+        signal(SIGPROF, SIG_IGN);
+        _yue_sampled = NULL;
+        atomic_store(&_yue_sampling, false);
+        prof->dropped += atomic_exchange(&_yue_sample_misses, 0);
+    }
+#endif
+}
+
+// Adds the samples taken since the last call to the call tree
+static void _yue_profile_fold(yue_Context *ctx, yue_Profile *prof)
+{
+    size_t end = prof->count_samples;
+    while(prof->folded_samples < end) {
+        size_t depth = prof->samples[prof->folded_samples];
+        uint32_t node = 0;
+        for(size_t i = 0; i < depth; ++i) {
+            node = _yue_profile_child(ctx, prof, node, prof->samples[prof->folded_samples + 1 + i]);
+        }
+        prof->nodes[node].samples += 1;
+        prof->folded_samples += depth + 1;
+    }
+}
+
+static void _yue_profile_path(FILE *out, yue_Profile *prof, uint32_t node)
+{
+    if(prof->nodes[node].parent != 0) {
+        _yue_profile_path(out, prof, prof->nodes[node].parent);
+        fputc(';', out);
+    }
+    fputs(prof->names.names[prof->nodes[node].name], out);
+}
+
+void yue_profile_folded(yue_Context *ctx, FILE *out)
+{
+    yue_Profile *prof = ctx->profile;
+    if(!prof) return;
+    if(prof->mode == YUE_PROFILE_SAMPLE) _yue_profile_fold(ctx, prof);
+    for(uint32_t i = 1; i < prof->count_nodes; ++i) {
+        yue_ProfileNode *node = &prof->nodes[i];
+        uint64_t count = prof->mode == YUE_PROFILE_SAMPLE ? node->samples : node->self_ns / 1000;
+        if(count == 0) continue;
+        _yue_profile_path(out, prof, i);
+        fprintf(out, " %llu\n", (unsigned long long)count);
+    }
+}
+
+typedef struct {
+    uint32_t name;
+    uint64_t calls;
+    uint64_t total;
+    uint64_t self;
+} yue_ProfileLine;
+
+static int _yue_profile_by_self(const void *a, const void *b)
+{
+    const yue_ProfileLine *lhs = a, *rhs = b;
+    return lhs->self < rhs->self ? 1 : lhs->self > rhs->self ? -1 : 0;
+}
+
+void yue_profile_report(yue_Context *ctx, FILE *out)
+{
+    yue_Profile *prof = ctx->profile;
+    if(!prof) return;
+    bool sampled = prof->mode == YUE_PROFILE_SAMPLE;
+    if(sampled) _yue_profile_fold(ctx, prof);
+    yue_ProfileLine *lines = calloc(prof->names.count_names ? prof->names.count_names : 1, sizeof(*lines));
+    if(!lines) return;
+    for(uint32_t i = 0; i < prof->names.count_names; ++i) lines[i].name = i;
+    for(uint32_t i = 1; i < prof->count_nodes; ++i) {
+        yue_ProfileNode *node = &prof->nodes[i];
+        yue_ProfileLine *line = &lines[node->name];
+        line->calls += node->calls;
+        line->self  += sampled ? node->samples : node->self_ns;
+        if(!sampled) {
+            // recursive calls are already part of the outermost call's time
+            bool nested = false;
+            for(uint32_t p = node->parent; p != 0 && !nested; p = prof->nodes[p].parent) nested = prof->nodes[p].name == node->name;
+            if(!nested) line->total += node->total_ns;
+        } else if(node->samples > 0) {
+            // every function on the sampled stack, once
+            for(uint32_t p = i; p != 0; p = prof->nodes[p].parent) {
+                bool seen = false;
+                for(uint32_t q = i; q != p && !seen; q = prof->nodes[q].parent) seen = prof->nodes[q].name == prof->nodes[p].name;
+                if(!seen) lines[prof->nodes[p].name].total += node->samples;
+            }
+        }
+    }
+    qsort(lines, prof->names.count_names, sizeof(*lines), _yue_profile_by_self);
+    if(sampled) {
+        fprintf(out, "%12s %12s  %s\n", "samples", "self", "name");
+        for(uint32_t i = 0; i < prof->names.count_names; ++i) {
+            if(lines[i].total == 0) continue;
+            fprintf(out, "%12llu %12llu  %s\n", (unsigned long long)lines[i].total, 
+                    (unsigned long long)lines[i].self, prof->names.names[lines[i].name]);
+        }
+        if(prof->dropped) fprintf(out, "%zu samples dropped\n", prof->dropped);
+    } else {
+        fprintf(out, "%12s %12s %12s  %s\n", "calls", "total ms", "self ms", "name");
+        for(uint32_t i = 0; i < prof->names.count_names; ++i) {
+            if(lines[i].calls == 0) continue;
+            fprintf(out, "%12llu %12.3f %12.3f  %s\n", (unsigned long long)lines[i].calls, 
+                    lines[i].total / 1e6, lines[i].self / 1e6, prof->names.names[lines[i].name]);
+        }
+    }
+    free(lines);
+}
+
+/////////////////////////
+///
+/// Heap profiler
+///
+
+// The site named name, added when it's new
+static uint32_t _yue_heap_intern(yue_Context *ctx, yue_HeapProfile *heap, const char *name)
+{
+    uint32_t id = _yue_names_intern(ctx, &heap->names, name);
+    if(id == heap->count_sites) {
+        if(heap->count_sites == heap->cap_sites)
+            heap->sites = _yue_profile_grow(ctx, heap->sites, &heap->cap_sites, sizeof(*heap->sites));
+        heap->count_sites += 1;
+        memset(&heap->sites[id], 0, sizeof(heap->sites[id]));
+        heap->sites[id].name = heap->names.names[id];
+    }
+    return id;
+}
+
+static void _yue_heap_tag(yue_Context *ctx, yue_Object *obj)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    if(heap->site == YUE_PROFILE_NONE) {
+        // sites are only named once something is allocated from them
+        char name[YUE_HEAP_SITE_NAME] = {0};
+        size_t len = 0;
+        uint32_t parts[3] = {heap->location, heap->function, heap->builtin};
+        for(int i = 0; i < 3; ++i) {
+            if(parts[i] == YUE_PROFILE_NONE) continue;
+            len += snprintf(name + len, sizeof(name) - len, "%s%s", len > 0 ? ";" : "", heap->sites[parts[i]].name);
+            if(len >= sizeof(name)) len = sizeof(name) - 1;
+        }
+        heap->site = _yue_heap_intern(ctx, heap, len > 0 ? name : "<host>");
+    }
+    yue_HeapSite *site = &heap->sites[heap->site];
+    site->allocations += 1;
+    site->recent      += 1;
+    heap->tags[obj - ctx->objects] = heap->site;
+}
+
+static yue_Object *_yue_heap_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    uint32_t function = heap->function;
+    uint32_t builtin  = heap->builtin;
+    if(base->type == YUE_OBJECT_SYMBOL) {
+        uint32_t name = _yue_heap_intern(ctx, heap, base->as_symbol.name);
+        if(fn->type == YUE_OBJECT_CFUNC || fn->type == YUE_OBJECT_NATIVE) {
+            heap->builtin = name;
+        } else {
+            heap->function = name;
+            heap->builtin  = YUE_PROFILE_NONE;
+        }
+        heap->site = YUE_PROFILE_NONE;
+    }
+    yue_Object *res = _yue_hooked_apply(ctx, YUE_HOOK_PROFILE, form, base, fn, arg);
+    // the profile may have been cleared by the call
+    if(ctx->heap_profile == heap) {
+        heap->function = function;
+        heap->builtin  = builtin;
+        heap->site     = YUE_PROFILE_NONE;
+    }
+    return res;
+}
+
+// Runs before a top-level form of yue_code_run
+static void _yue_heap_form(yue_Context *ctx, yue_Code *code, size_t line)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    char name[YUE_PROFILE_NAME];
+    _yue_form_name(code, line, name, sizeof(name));
+    heap->location = _yue_heap_intern(ctx, heap, name);
+    heap->function = YUE_PROFILE_NONE;
+    heap->builtin  = YUE_PROFILE_NONE;
+    heap->site     = YUE_PROFILE_NONE;
+}
+
+static int _yue_heap_by_retained(const void *a, const void *b)
+{
+    const yue_HeapSite *lhs = *(const yue_HeapSite **)a, *rhs = *(const yue_HeapSite **)b;
+    if(lhs->retained != rhs->retained) return lhs->retained < rhs->retained ? 1 : -1;
+    return lhs->recent < rhs->recent ? 1 : lhs->recent > rhs->recent ? -1 : 0;
+}
+
+static int _yue_heap_by_allocations(const void *a, const void *b)
+{
+    const yue_HeapSite *lhs = *(const yue_HeapSite **)a, *rhs = *(const yue_HeapSite **)b;
+    return lhs->allocations < rhs->allocations ? 1 : lhs->allocations > rhs->allocations ? -1 : 0;
+}
+
+static int _yue_heap_by_name(const void *a, const void *b)
+{
+    return strcmp((*(const yue_HeapSite **)a)->name, (*(const yue_HeapSite **)b)->name);
+}
+
+// Sweep counted what every site retains, called after each collection
+static void _yue_heap_collected(yue_HeapProfile *heap)
+{
+    heap->collections += 1;
+    uint64_t now = _yue_now_ns();
+    double elapsed_ms = (double)(now - heap->last_ns) / 1e6;
+    heap->last_ns = now;
+
+    yue_HeapSite **top = heap->log ? malloc(heap->count_sites * sizeof(*top)) : NULL;
+    size_t count_top = 0, retained = 0;
+    for(uint32_t i = 0; i < heap->count_sites; ++i) {
+        yue_HeapSite *site = &heap->sites[i];
+        if(site->retained > site->peak_retained) site->peak_retained = site->retained;
+        retained += site->retained;
+        if(top && (site->retained > 0 || site->recent > 0)) top[count_top++] = site;
+    }
+    if(top) {
+        qsort(top, count_top, sizeof(*top), _yue_heap_by_retained);
+        fprintf(heap->log, "gc %zu: %zu objects retained, %zu bytes, %.3f ms since the last one\n",
+                heap->collections, retained, retained * sizeof(yue_Object), elapsed_ms);
+        fprintf(heap->log, "%10s %12s %10s %10s  %s\n", "retained", "bytes", "allocated", "allocs/ms", "site");
+        for(size_t i = 0; i < count_top && i < YUE_HEAP_REPORT_TOP; ++i) {
+            yue_HeapSite *site = top[i];
+            fprintf(heap->log, "%10llu %12llu %10llu %10.1f  %s\n",
+                    (unsigned long long)site->retained, (unsigned long long)(site->retained * sizeof(yue_Object)),
+                    (unsigned long long)site->recent, elapsed_ms > 0 ? (double)site->recent / elapsed_ms : 0.0, site->name);
+        }
+        fflush(heap->log);
+        free(top);
+    }
+    for(uint32_t i = 0; i < heap->count_sites; ++i) heap->sites[i].recent = 0;
+}
+
+void yue_heap_clear(yue_Context *ctx)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    if(!heap) return;
+    _yue_names_free(&heap->names);
+    free(heap->sites);
+    free(heap->tags);
+    free(heap);
+    ctx->heap_profile = NULL;
+}
+
+bool yue_heap_start(yue_Context *ctx, FILE *log)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    if(!heap) {
+        heap = calloc(1, sizeof(*heap));
+        if(!heap) return false;
+        heap->cap_sites   = 256;
+        heap->sites       = malloc(heap->cap_sites * sizeof(*heap->sites));
+        // objects allocated before are tagged 0, which is the first site
+        heap->tags        = calloc(ctx->count_objects ? ctx->count_objects : 1, sizeof(*heap->tags));
+        if(!heap->sites || !heap->tags || _yue_names_add(&heap->names, "<before profiling>") != 0) {
+            _yue_names_free(&heap->names);
+            free(heap->sites);
+            free(heap->tags);
+            free(heap);
+            return false;
+        }
+        heap->count_sites = 1;
+        memset(&heap->sites[0], 0, sizeof(heap->sites[0]));
+        heap->sites[0].name = heap->names.names[0];
+        ctx->heap_profile = heap;
+    }
+    heap->log      = log;
+    heap->location = YUE_PROFILE_NONE;
+    heap->function = YUE_PROFILE_NONE;
+    heap->builtin  = YUE_PROFILE_NONE;
+    heap->site     = YUE_PROFILE_NONE;
+    heap->last_ns  = _yue_now_ns();
+    heap->running  = true;
+    return true;
+}
+
+void yue_heap_stop(yue_Context *ctx)
+{
+    if(ctx->heap_profile) ctx->heap_profile->running = false;
+}
+
+void yue_heap_report(yue_Context *ctx, FILE *out)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    if(!heap) return;
+    yue_HeapSite **sites = malloc(heap->count_sites * sizeof(*sites));
+    if(!sites) return;
+    size_t count_sites = 0;
+    for(uint32_t i = 0; i < heap->count_sites; ++i) {
+        if(heap->sites[i].allocations > 0 || heap->sites[i].peak_retained > 0) sites[count_sites++] = &heap->sites[i];
+    }
+    qsort(sites, count_sites, sizeof(*sites), _yue_heap_by_allocations);
+    fprintf(out, "%12s %10s %10s  %s\n", "allocated", "retained", "peak", "site");
+    for(size_t i = 0; i < count_sites; ++i) {
+        fprintf(out, "%12llu %10llu %10llu  %s\n", (unsigned long long)sites[i]->allocations,
+                (unsigned long long)sites[i]->retained, (unsigned long long)sites[i]->peak_retained, sites[i]->name);
+    }
+    fprintf(out, "%zu collections, retained counts are from the last one\n", heap->collections);
+    free(sites);
+}
+
+void yue_heap_snapshot(yue_Context *ctx, FILE *out)
+{
+    yue_HeapProfile *heap = ctx->heap_profile;
+    if(!heap) return;
+    size_t *counts = calloc((size_t)heap->count_sites * YUE_OBJECT_TYPE_COUNT, sizeof(*counts));
+    yue_HeapSite **sites = malloc(heap->count_sites * sizeof(*sites));
+    if(!counts || !sites) {
+        free(counts);
+        free(sites);
+        return;
+    }
+    mark_all(ctx);
+    for(size_t i = 0; i < ctx->fresh_objects; ++i) {
+        yue_Object *obj = &ctx->objects[i];
+        if(!obj->marked) continue;
+        obj->marked = false;
+        counts[(size_t)heap->tags[i] * YUE_OBJECT_TYPE_COUNT + obj->type] += 1;
+    }
+    for(uint32_t i = 0; i < heap->count_sites; ++i) sites[i] = &heap->sites[i];
+    // sorted by name so snapshots can be compared with diff
+    qsort(sites, heap->count_sites, sizeof(*sites), _yue_heap_by_name);
+    for(uint32_t i = 0; i < heap->count_sites; ++i) {
+        size_t id = sites[i] - heap->sites;
+        for(int type = 0; type < YUE_OBJECT_TYPE_COUNT; ++type) {
+            size_t count = counts[id * YUE_OBJECT_TYPE_COUNT + type];
+            if(count == 0) continue;
+            char name[32];
+            fprintf(out, "%s\t%s\t%zu\t%zu\n", sites[i]->name, _yue_type_label(type, name, sizeof(name)),
+                    count, count * sizeof(yue_Object));
+        }
+    }
+    free(sites);
+    free(counts);
+}
+
+// (heap-snapshot path) writes the live objects by allocation site to path, see yue_heap_snapshot
+yue_Object *yue_builtin_heap_snapshot(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *path = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    if(path->type != YUE_OBJECT_STRING) yue_error(ctx, "`heap-snapshot` requires a string but found %s", _yue_type_names[path->type]);
+    if(!ctx->heap_profile) yue_error(ctx, "`heap-snapshot` requires the heap profiler to be started");
+    char filepath[1024];
+    yue_tostring(ctx, path, filepath, sizeof(filepath));
+    FILE *f = fopen(filepath, "w");
+    if(!f) yue_error(ctx, "`heap-snapshot` could not open %s", filepath);
+    yue_heap_snapshot(ctx, f);
+    fclose(f);
+    return path;
+}
+
+/////////////////////////
+///
+/// Hardware counters
+///
+
+static const char *_yue_counter_names[YUE_COUNTER_COUNT] = {
+    [YUE_COUNTER_CYCLES]        = "cycles",
+    [YUE_COUNTER_INSTRUCTIONS]  = "instructions",
+    [YUE_COUNTER_BRANCH_MISSES] = "branch-misses",
+    [YUE_COUNTER_L1D_MISSES]    = "l1d-misses",
+    [YUE_COUNTER_LLC_MISSES]    = "llc-misses",
+    [YUE_COUNTER_DTLB_MISSES]   = "dtlb-misses",
+};
+
+#if defined(__linux__)
+static int _yue_counter_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// The kernel multiplexes counters when there are more than the PMU has, those are
+// scaled by the fraction of time they actually ran
+static uint64_t _yue_counter_read(int fd)
+{
+    uint64_t values[3];
+    if(read(fd, values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0) return 0;
+    if(values[2] < values[1]) return (uint64_t)((double)values[0] * (double)values[1] / (double)values[2]);
+    return values[0];
+}
+#endif
+
+static void _yue_counters_read(yue_Counters *counters, yue_CounterSet *set)
+{
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) {
+#if defined(__linux__)
+        set->value[i] = counters->fds[i] >= 0 ? _yue_counter_read(counters->fds[i]) : 0;
+#else
+        set->value[i] = 0;
+#endif
+    }
+}
+
+static void _yue_counters_add(yue_CounterSet *dst, const yue_CounterSet *src)
+{
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) dst->value[i] += src->value[i];
+}
+
+void yue_counters_begin(yue_Context *ctx, yue_CounterSet *region)
+{
+    if(ctx->counters) {
+        _yue_counters_read(ctx->counters, region);
+    } else {
+        memset(region, 0, sizeof(*region));
+    }
+}
+
+void yue_counters_end(yue_Context *ctx, yue_CounterSet *region)
+{
+    yue_CounterSet now = {0};
+    if(ctx->counters) _yue_counters_read(ctx->counters, &now);
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) region->value[i] = now.value[i] - region->value[i];
+}
+
+bool yue_counters_available(yue_Context *ctx, yue_Counter counter)
+{
+    return ctx->counters && ctx->counters->fds[counter] >= 0;
+}
+
+// Runs around a top-level form of yue_code_run, a form run again adds to the same line
+static void _yue_counters_form(yue_Context *ctx, yue_Code *code, size_t line, const yue_CounterSet *counted)
+{
+    yue_Counters *counters = ctx->counters;
+    char name[YUE_PROFILE_NAME];
+    _yue_form_name(code, line, name, sizeof(name));
+    uint32_t found = _yue_names_intern(ctx, &counters->names, name);
+    if(found == counters->count_forms) {
+        if(counters->count_forms == counters->cap_forms)
+            counters->forms = _yue_profile_grow(ctx, counters->forms, &counters->cap_forms, sizeof(*counters->forms));
+        counters->count_forms += 1;
+        memset(&counters->forms[found], 0, sizeof(counters->forms[found]));
+        counters->forms[found].name = counters->names.names[found];
+    }
+    counters->forms[found].runs += 1;
+    _yue_counters_add(&counters->forms[found].counted, counted);
+}
+
+void yue_counters_clear(yue_Context *ctx)
+{
+    yue_Counters *counters = ctx->counters;
+    if(!counters) return;
+#if defined(__linux__)
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) {
+        if(counters->fds[i] >= 0) close(counters->fds[i]);
+    }
+#endif
+    _yue_names_free(&counters->names);
+    free(counters->forms);
+    free(counters);
+    ctx->counters = NULL;
+}
+
+bool yue_counters_start(yue_Context *ctx)
+{
+#if defined(__linux__)
+    yue_Counters *counters = ctx->counters;
+    if(!counters) {
+        counters = calloc(1, sizeof(*counters));
+        if(!counters) return false;
+        static const struct { uint32_t type; uint64_t config; } events[YUE_COUNTER_COUNT] = {
+            [YUE_COUNTER_CYCLES]        = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            [YUE_COUNTER_INSTRUCTIONS]  = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            [YUE_COUNTER_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            [YUE_COUNTER_L1D_MISSES]    = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            [YUE_COUNTER_LLC_MISSES]    = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            [YUE_COUNTER_DTLB_MISSES]   = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        };
+        // counters the kernel or the hardware doesn't permit are left out
+        int count_open = 0;
+        for(int i = 0; i < YUE_COUNTER_COUNT; ++i) {
+            counters->fds[i] = _yue_counter_open(events[i].type, events[i].config);
+            if(counters->fds[i] >= 0) count_open += 1;
+        }
+        if(count_open == 0) {
+            free(counters);
+            return false;
+        }
+        ctx->counters = counters;
+    }
+    if(counters->running) return true;
+    counters->start_ns = _yue_now_ns();
+    _yue_counters_read(counters, &counters->start);
+    counters->running = true;
+    return true;
+#else
+    (void)ctx;
+    return false;
+#endif
+}
+
+void yue_counters_stop(yue_Context *ctx)
+{
+    yue_Counters *counters = ctx->counters;
+    if(!counters || !counters->running) return;
+    yue_CounterSet run = counters->start;
+    yue_counters_end(ctx, &run);
+    _yue_counters_add(&counters->run, &run);
+    counters->run_ns += _yue_now_ns() - counters->start_ns;
+    counters->running = false;
+}
+
+static void _yue_counters_line(FILE *out, yue_Counters *counters, const yue_CounterSet *set, double per, const char *name)
+{
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) {
+        if(counters->fds[i] < 0) {
+            fprintf(out, " %14s", "-");
+        } else {
+            fprintf(out, " %14.0f", (double)set->value[i] / per);
+        }
+    }
+    if(counters->fds[YUE_COUNTER_CYCLES] >= 0 && counters->fds[YUE_COUNTER_INSTRUCTIONS] >= 0 && set->value[YUE_COUNTER_CYCLES] > 0) {
+        fprintf(out, " %6.2f", (double)set->value[YUE_COUNTER_INSTRUCTIONS] / (double)set->value[YUE_COUNTER_CYCLES]);
+    } else {
+        fprintf(out, " %6s", "-");
+    }
+    fprintf(out, "  %s\n", name);
+}
+
+static int _yue_counters_by_cost(const void *a, const void *b)
+{
+    const yue_CounterForm *lhs = *(const yue_CounterForm **)a, *rhs = *(const yue_CounterForm **)b;
+    // cycles when there are any, instructions otherwise
+    uint64_t l = lhs->counted.value[YUE_COUNTER_CYCLES] + lhs->counted.value[YUE_COUNTER_INSTRUCTIONS];
+    uint64_t r = rhs->counted.value[YUE_COUNTER_CYCLES] + rhs->counted.value[YUE_COUNTER_INSTRUCTIONS];
+    return l < r ? 1 : l > r ? -1 : 0;
+}
+
+void yue_counters_report(yue_Context *ctx, FILE *out)
+{
+    yue_Counters *counters = ctx->counters;
+    if(!counters) return;
+    yue_CounterSet run = counters->run;
+    uint64_t run_ns = counters->run_ns;
+    if(counters->running) {
+        // still counting, the run so far
+        yue_CounterSet now = counters->start;
+        yue_counters_end(ctx, &now);
+        _yue_counters_add(&run, &now);
+        run_ns += _yue_now_ns() - counters->start_ns;
+    }
+
+    fprintf(out, "hardware counters over %.3f ms, - was not permitted\n", (double)run_ns / 1e6);
+    for(int i = 0; i < YUE_COUNTER_COUNT; ++i) fprintf(out, " %14s", _yue_counter_names[i]);
+    fprintf(out, " %6s  %s\n", "ipc", "region");
+    _yue_counters_line(out, counters, &run, 1, "run");
+    char name[64];
+    snprintf(name, sizeof(name), "gc, %zu collections", counters->collections);
+    _yue_counters_line(out, counters, &counters->gc, 1, name);
+    if(counters->collections > 0) _yue_counters_line(out, counters, &counters->gc, (double)counters->collections, "gc, per collection");
+
+    yue_CounterForm **forms = malloc((counters->count_forms ? counters->count_forms : 1) * sizeof(*forms));
+    if(!forms) return;
+    for(uint32_t i = 0; i < counters->count_forms; ++i) forms[i] = &counters->forms[i];
+    qsort(forms, counters->count_forms, sizeof(*forms), _yue_counters_by_cost);
+    // collections during a form are counted in the form too
+    for(uint32_t i = 0; i < counters->count_forms && i < YUE_COUNTER_REPORT_TOP; ++i) {
+        _yue_counters_line(out, counters, &forms[i]->counted, 1, forms[i]->name);
+    }
+    if(counters->count_forms > YUE_COUNTER_REPORT_TOP) {
+        fprintf(out, "%u more forms\n", counters->count_forms - YUE_COUNTER_REPORT_TOP);
+    }
+    free(forms);
+}
+
+/////////////////////////
+///
+/// Tracing
+///
+
+static uint32_t _yue_trace_intern(yue_Trace *trace, const char *name)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    size_t len = 0;
+    for(const char *c = name; *c && len < YUE_TRACE_NAME - 1; ++c, ++len) hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    uint32_t mask = YUE_TRACE_NAMES * 2 - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    uint32_t count = atomic_load_explicit(&trace->count_names, memory_order_relaxed);
+    while(trace->slots[slot] != YUE_PROFILE_NONE) {
+        const char *other = trace->names[trace->slots[slot]];
+        if(strncmp(other, name, len) == 0 && other[len] == 0) return trace->slots[slot];
+        slot = (slot + 1) & mask;
+    }
+    // the last name stands for every name that didn't fit
+    if(count == YUE_TRACE_NAMES - 1) return count;
+    memcpy(trace->names[count], name, len);
+    trace->names[count][len] = 0;
+    trace->slots[slot] = count;
+    // readers only look at names below count_names
+    atomic_store_explicit(&trace->count_names, count + 1, memory_order_release);
+    return count;
+}
+
+static void _yue_trace_push(yue_Trace *trace, yue_TraceKind kind, uint32_t name, uint64_t arg)
+{
+    size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    yue_TraceEvent *event = &trace->events[head & (YUE_TRACE_EVENTS - 1)];
+    event->ns   = _yue_now_ns() - trace->start_ns;
+    event->name = name;
+    event->kind = (uint32_t)kind;
+    event->arg  = arg;
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+void yue_trace_event(yue_Context *ctx, yue_TraceKind kind, const char *name, uint64_t arg)
+{
+    yue_Trace *trace = ctx->trace;
+    if(!trace || !trace->running) return;
+    _yue_trace_push(trace, kind, name ? _yue_trace_intern(trace, name) : YUE_PROFILE_NONE, arg);
+}
+
+static yue_Object *_yue_trace_apply(yue_Context *ctx, yue_Object *form, yue_Object *base, yue_Object *fn, yue_Object *arg)
+{
+    yue_Trace *trace = ctx->trace;
+    uint32_t name = _yue_trace_intern(trace, base->type == YUE_OBJECT_SYMBOL ? base->as_symbol.name : "<anonymous>");
+    _yue_trace_push(trace, YUE_TRACE_ENTER, name, 0);
+    trace->depth += 1;
+    yue_Object *res = _yue_hooked_apply(ctx, YUE_HOOK_HEAP, form, base, fn, arg);
+    // the trace may have been stopped by the call
+    if(ctx->trace == trace && trace->running && trace->depth > 0) {
+        trace->depth -= 1;
+        _yue_trace_push(trace, YUE_TRACE_EXIT, name, 0);
+    }
+    return res;
+}
+
+// An error unwound the calls above depth, their exits are at the time of the error
+static void _yue_trace_unwind(yue_Trace *trace, size_t depth)
+{
+    while(trace->depth > depth) {
+        trace->depth -= 1;
+        _yue_trace_push(trace, YUE_TRACE_EXIT, YUE_PROFILE_NONE, 0);
+    }
+}
+
+void yue_trace_clear(yue_Context *ctx)
+{
+    free(ctx->trace);
+    ctx->trace = NULL;
+}
+
+bool yue_trace_start(yue_Context *ctx)
+{
+    yue_Trace *trace = ctx->trace;
+    if(!trace) {
+        trace = calloc(1, sizeof(*trace));
+        if(!trace) return false;
+        for(uint32_t i = 0; i < YUE_TRACE_NAMES * 2; ++i) trace->slots[i] = YUE_PROFILE_NONE;
+        snprintf(trace->names[YUE_TRACE_NAMES - 1], YUE_TRACE_NAME, "<more names>");
+        trace->start_ns = _yue_now_ns();
+        ctx->trace = trace;
+    }
+    trace->depth   = 0;
+    trace->running = true;
+    return true;
+}
+
+void yue_trace_stop(yue_Context *ctx)
+{
+    if(ctx->trace) ctx->trace->running = false;
+}
+
+#define YUE_TRACE_MAGIC "YUETRACE"
+#define YUE_TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t count_names;
+    uint64_t count_events;
+    uint64_t dropped;
+} yue_TraceHeader;
+
+bool yue_trace_save(yue_Context *ctx, FILE *out)
+{
+    yue_Trace *trace = ctx->trace;
+    if(!trace) return false;
+    size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    size_t first = head > YUE_TRACE_EVENTS ? head - YUE_TRACE_EVENTS : 0;
+    yue_TraceEvent *events = malloc((head - first ? head - first : 1) * sizeof(*events));
+    if(!events) return false;
+    for(size_t i = first; i < head; ++i) events[i - first] = trace->events[i & (YUE_TRACE_EVENTS - 1)];
+    // events the context wrote over while they were copied are dropped
+    size_t now = atomic_load_explicit(&trace->head, memory_order_acquire);
+    size_t valid = now > YUE_TRACE_EVENTS ? now - YUE_TRACE_EVENTS : 0;
+    size_t skip = valid > first ? valid - first : 0;
+    if(skip > head - first) skip = head - first;
+
+    yue_TraceHeader header = {
+        .magic        = YUE_TRACE_MAGIC,
+        .version      = YUE_TRACE_VERSION,
+        .count_names  = atomic_load_explicit(&trace->count_names, memory_order_acquire),
+        .count_events = head - first - skip,
+        .dropped      = first + skip,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+        fwrite(trace->names, YUE_TRACE_NAME, header.count_names, out) == header.count_names &&
+        fwrite(events + skip, sizeof(*events), header.count_events, out) == header.count_events;
+    free(events);
+    return ok;
+}
+
+static void _yue_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for(const unsigned char *c = (const unsigned char *)str; *c; ++c) {
+        if(*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if(*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+bool yue_trace_json(FILE *in, FILE *out)
+{
+    yue_TraceHeader header;
+    if(fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, YUE_TRACE_MAGIC, 8) != 0 ||
+        header.version != YUE_TRACE_VERSION || header.count_names > YUE_TRACE_NAMES) return false;
+    char (*names)[YUE_TRACE_NAME] = malloc((header.count_names ? header.count_names : 1) * YUE_TRACE_NAME);
+    if(!names) return false;
+    if(fread(names, YUE_TRACE_NAME, header.count_names, in) != header.count_names) {
+        free(names);
+        return false;
+    }
+    for(uint32_t i = 0; i < header.count_names; ++i) names[i][YUE_TRACE_NAME - 1] = 0;
+
+    fprintf(out, "{\"otherData\":{\"dropped\":%llu},\"traceEvents\":[\n", (unsigned long long)header.dropped);
+    yue_TraceEvent event;
+    uint64_t last_alloc_ns = 0;
+    bool first = true;
+    for(uint64_t i = 0; i < header.count_events && fread(&event, sizeof(event), 1, in) == 1; ++i) {
+        const char *name = event.name < header.count_names ? names[event.name] : "";
+        double ts = (double)event.ns / 1e3;
+        if(!first) fputs(",\n", out);
+        first = false;
+        switch((yue_TraceKind)event.kind) {
+        case YUE_TRACE_ENTER:
+        case YUE_TRACE_EXIT:
+            fprintf(out, "{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"cat\":\"call\",\"name\":",
+                    event.kind == YUE_TRACE_ENTER ? "B" : "E", ts);
+            _yue_json_string(out, name);
+            fputc('}', out);
+            break;
+        case YUE_TRACE_GC_BEGIN:
+            fprintf(out, "{\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"cat\":\"gc\",\"name\":\"gc\"}", ts);
+            break;
+        case YUE_TRACE_GC_END:
+            fprintf(out, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"cat\":\"gc\",\"name\":\"gc\",\"args\":{\"freed\":%llu}}",
+                    ts, (unsigned long long)event.arg);
+            break;
+        case YUE_TRACE_ALLOC:
+            {
+                // allocations per ms since the previous burst
+                double ms = (double)(event.ns - last_alloc_ns) / 1e6;
+                last_alloc_ns = event.ns;
+                fprintf(out, "{\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"name\":\"allocations\",\"args\":{\"per_ms\":%.1f}}",
+                        ts, ms > 0 ? (double)event.arg / ms : 0.0);
+            } break;
+        default:
+            {
+                const char *cat = event.kind == YUE_TRACE_PLUGIN ? "plugin" : event.kind == YUE_TRACE_ERROR ? "error" : "mark";
+                fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"cat\":\"%s\",\"name\":", ts, cat);
+                _yue_json_string(out, name);
+                fprintf(out, ",\"args\":{\"value\":%llu}}", (unsigned long long)event.arg);
+            } break;
+        }
+    }
+    fputs("\n]}\n", out);
+    free(names);
+    return true;
+}
+
+/////////////////////////
+///
+/// Macros
+///
+
+static yue_Object *_yue_macro_apply(yue_Context *ctx, yue_Object *macro, yue_Object *args)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = _yue_invoke(ctx, macro, args);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+static bool _yue_issymbol(yue_Object *obj, const char *name)
+{
+    return obj->type == YUE_OBJECT_SYMBOL && strcmp(obj->as_symbol.name, name) == 0;
+}
+
+// Expands every macro call in obj. Lists are changed in place so each call is expanded
+// once, except those of another context (shared code) which are left as they are
+static yue_Object *_yue_macroexpand(yue_Context *ctx, yue_Object *obj)
+{
+    size_t gc = yue_savegc(ctx);
+    while(obj->type == YUE_OBJECT_PAIR) {
+        yue_Object *head = obj->as_pair.head;
+        if(head->type != YUE_OBJECT_SYMBOL || _yue_issymbol(head, "quote")) break;
+        yue_Object *macro = yue_get(ctx, head);
+        if(macro->type != YUE_OBJECT_MACRO) break;
+        obj = _yue_macro_apply(ctx, macro, obj->as_pair.tail);
+    }
+    if(obj->type != YUE_OBJECT_PAIR || _yue_issymbol(obj->as_pair.head, "quote")) {
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, obj);
+        return obj;
+    }
+
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, obj);
+    gc = yue_savegc(ctx);
+    yue_Object *curr = obj;
+    // parameters are not calls
+    if(_yue_issymbol(obj->as_pair.head, "fn")) {
+        curr = curr->as_pair.tail;
+        if(curr->type == YUE_OBJECT_PAIR) curr = curr->as_pair.tail;
+    } else if(_yue_issymbol(obj->as_pair.head, "defmacro")) {
+        for(int i = 0; i < 3 && curr->type == YUE_OBJECT_PAIR; ++i) curr = curr->as_pair.tail;
+    }
+    for(; curr->type == YUE_OBJECT_PAIR && _yue_owns(ctx, curr); curr = curr->as_pair.tail) {
+        curr->as_pair.head = _yue_macroexpand(ctx, curr->as_pair.head);
+        yue_restoregc(ctx, gc);
+    }
+    return obj;
+}
+
+// A call to a macro that wasn't expanded when it was read, because the macro was
+// defined later. The form is replaced by its expansion for the next evaluations
+static yue_Object *_yue_macro_replace(yue_Context *ctx, yue_Object *form, yue_Object *macro)
+{
+    yue_Object *res = _yue_macroexpand(ctx, _yue_macro_apply(ctx, macro, form->as_pair.tail));
+    if(!_yue_owns(ctx, form)) return res;
+    if(res->type == YUE_OBJECT_PAIR) {
+        form->as_pair = res->as_pair;
+    } else {
+        form->as_pair.tail = yue_pair(ctx, res, yue_nil(ctx));
+        form->as_pair.head = yue_symbol(ctx, "do");
+    }
+    return res;
+}
+
+// (defmacro name (params...) body)
+// body runs with params bound to the unevaluated arguments, what it returns replaces the call
+yue_Object *yue_builtin_defmacro(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *name   = yue_nextarg(ctx, &arg);
+    yue_Object *params = yue_nextarg(ctx, &arg);
+    yue_Object *body   = yue_nextarg(ctx, &arg);
+    if(name->type != YUE_OBJECT_SYMBOL) yue_error(ctx, "`defmacro` requires a name but found %s", _yue_type_names[name->type]);
+    yue_Object *macro = yue_func(ctx, params, body);
+    macro->type = YUE_OBJECT_MACRO;
+    yue_set(ctx, name, macro);
+    ctx->count_macros += 1;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, macro);
+    return macro;
+}
+
+// (gensym), a fresh symbol for the bindings a macro introduces
+yue_Object *yue_builtin_gensym(yue_Context *ctx, yue_Object *arg)
+{
+    (void)arg;
+    char name[YUE_STRING_DATA_SIZE];
+    ctx->count_gensyms += 1;
+    snprintf(name, sizeof(name), "#:g%zu", ctx->count_gensyms);
+    return yue_symbol(ctx, name);
+}
+
+static yue_Object *_yue_stat(yue_Context *ctx, const char *name, yue_Object *value, yue_Object *rest)
+{
+    return yue_pair(ctx, yue_pair(ctx, yue_symbol(ctx, name), value), rest);
+}
+
+// (gc-stats), an association list of the collector's counters with the live objects by type under census
+yue_Object *yue_builtin_gc_stats(yue_Context *ctx, yue_Object *arg)
+{
+    (void)arg;
+    yue_GCStats stats = {0};
+    yue_gcstats(ctx, &stats);
+    size_t gc = yue_savegc(ctx);
+    yue_Object *census = yue_nil(ctx);
+    for(int type = YUE_OBJECT_TYPE_COUNT - 1; type >= 0; --type) {
+        if(stats.live[type] == 0) continue;
+        char name[32];
+        census = _yue_stat(ctx, _yue_type_label(type, name, sizeof(name)), yue_number(ctx, (yue_Number)stats.live[type]), census);
+    }
+    yue_Object *res = _yue_stat(ctx, "census", census, yue_nil(ctx));
+    res = _yue_stat(ctx, "scope-high-water", yue_number(ctx, (yue_Number)stats.scope_high_water), res);
+    res = _yue_stat(ctx, "stack-high-water", yue_number(ctx, (yue_Number)stats.stack_high_water), res);
+    res = _yue_stat(ctx, "count-objects", yue_number(ctx, (yue_Number)stats.count_objects), res);
+    res = _yue_stat(ctx, "fresh-objects", yue_number(ctx, (yue_Number)stats.fresh_objects), res);
+    res = _yue_stat(ctx, "free-list", yue_number(ctx, (yue_Number)stats.free_list), res);
+    res = _yue_stat(ctx, "total-freed", yue_number(ctx, (yue_Number)stats.total_freed), res);
+    res = _yue_stat(ctx, "freed", yue_number(ctx, (yue_Number)stats.freed), res);
+    res = _yue_stat(ctx, "marked", yue_number(ctx, (yue_Number)stats.marked), res);
+    res = _yue_stat(ctx, "max-pause-ms", yue_number(ctx, (yue_Number)stats.max_pause_ms), res);
+    res = _yue_stat(ctx, "total-pause-ms", yue_number(ctx, (yue_Number)stats.total_pause_ms), res);
+    res = _yue_stat(ctx, "collections", yue_number(ctx, (yue_Number)stats.collections), res);
+    res = _yue_stat(ctx, "allocations", yue_number(ctx, (yue_Number)stats.allocations), res);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// The builtins of yue_load_builtins. Each one is bound as a global the first time a context
+// looks its name up, see _yue_builtin_get. The functions are static objects shared by every
+// context, so a context only pays a symbol for each builtin it uses.
+#define YUE_BUILTIN(name, fn) {name, {.type = YUE_OBJECT_CFUNC, .as_cfunc = fn}}
+static yue_Builtin _yue_builtins[] = {
+    YUE_BUILTIN("print",          yue_builtin_print),
+    YUE_BUILTIN("+",              yue_builtin_add),
+    YUE_BUILTIN("-",              yue_builtin_sub),
+    YUE_BUILTIN("*",              yue_builtin_mul),
+    YUE_BUILTIN("=",              yue_builtin_assign),
+    YUE_BUILTIN("not",            yue_builtin_not),
+    YUE_BUILTIN("and",            yue_builtin_and),
+    YUE_BUILTIN("or",             yue_builtin_or),
+    YUE_BUILTIN("eq",             yue_builtin_eq),
+    YUE_BUILTIN("ne",             yue_builtin_ne),
+    YUE_BUILTIN("lt",             yue_builtin_lt),
+    YUE_BUILTIN("gt",             yue_builtin_gt),
+    YUE_BUILTIN("le",             yue_builtin_le),
+    YUE_BUILTIN("ge",             yue_builtin_ge),
+    YUE_BUILTIN("exit",           yue_builtin_exit),
+    YUE_BUILTIN("try",            yue_builtin_try),
+    YUE_BUILTIN("quote",          yue_builtin_quote),
+    YUE_BUILTIN("coroutine",      yue_builtin_coroutine),
+    YUE_BUILTIN("resume",         yue_builtin_resume),
+    YUE_BUILTIN("yield",          yue_builtin_yield),
+    YUE_BUILTIN("coroutine-done", yue_builtin_coroutine_done),
+    YUE_BUILTIN("pmap",           yue_builtin_pmap),
+    YUE_BUILTIN("preduce",        yue_builtin_preduce),
+    YUE_BUILTIN("serialize",      yue_builtin_serialize),
+    YUE_BUILTIN("deserialize",    yue_builtin_deserialize),
+    YUE_BUILTIN("seq",            yue_builtin_seq),
+    YUE_BUILTIN("range",          yue_builtin_range),
+    YUE_BUILTIN("lines",          yue_builtin_lines),
+    YUE_BUILTIN("map",            yue_builtin_map),
+    YUE_BUILTIN("filter",         yue_builtin_filter),
+    YUE_BUILTIN("take",           yue_builtin_take),
+    YUE_BUILTIN("reduce",         yue_builtin_reduce),
+    YUE_BUILTIN("collect",        yue_builtin_collect),
+    YUE_BUILTIN("do",             yue_builtin_dolist),
+    YUE_BUILTIN("while",          yue_builtin_while),
+    YUE_BUILTIN("if",             yue_builtin_if),
+    YUE_BUILTIN("fn",             yue_builtin_fn),
+    YUE_BUILTIN("list",           yue_builtin_list),
+    YUE_BUILTIN("head",           yue_builtin_head),
+    YUE_BUILTIN("tail",           yue_builtin_tail),
+    YUE_BUILTIN("streq",          yue_builtin_streq),
+    YUE_BUILTIN("length",         yue_builtin_length),
+    YUE_BUILTIN("nth",            yue_builtin_nth),
+    YUE_BUILTIN("append",         yue_builtin_append),
+    YUE_BUILTIN("reverse",        yue_builtin_reverse),
+    YUE_BUILTIN("assoc",          yue_builtin_assoc),
+    YUE_BUILTIN("member",         yue_builtin_member),
+    YUE_BUILTIN("sort",           yue_builtin_sort),
+    YUE_BUILTIN("memo",           yue_builtin_memo),
+    YUE_BUILTIN("memo-stats",     yue_builtin_memo_stats),
+    YUE_BUILTIN("batch",          yue_builtin_batch),
+    YUE_BUILTIN("batch-add",      yue_builtin_batch_add),
+    YUE_BUILTIN("batch-run",      yue_builtin_batch_run),
+    YUE_BUILTIN("batch-clear",    yue_builtin_batch_clear),
+    YUE_BUILTIN("require",        yue_builtin_require),
+    YUE_BUILTIN("defrecord",      yue_builtin_defrecord),
+    YUE_BUILTIN("defmacro",       yue_builtin_defmacro),
+    YUE_BUILTIN("gensym",         yue_builtin_gensym),
+    YUE_BUILTIN("gc-stats",       yue_builtin_gc_stats),
+    YUE_BUILTIN("heap-snapshot",  yue_builtin_heap_snapshot),
+};
+
+void yue_load_builtins(yue_Context *ctx)
+{
+    ctx->builtins = true;
+}
+
+// A copy of what obj holds, for yue_reset to put back, see _yue_restore
+static yue_Object *_yue_snapshot(yue_Context *ctx, yue_Object *obj)
+{
+    yue_Object *copy = new_object(ctx, obj->type);
+    copy->as_record = NULL;
+    bool ok = true;
+    if(obj->type == YUE_OBJECT_RECORD) {
+        size_t size = sizeof(yue_Record) + obj->as_record->count * sizeof(yue_Object*);
+        copy->as_record = malloc(size);
+        if(copy->as_record) memcpy(copy->as_record, obj->as_record, size);
+        ok = copy->as_record != NULL;
+    } else if(obj->type == YUE_OBJECT_MEMO) {
+        const yue_Memo *memo = obj->as_memo;
+        size_t size = sizeof(yue_Memo) + memo->capacity * sizeof(yue_MemoEntry);
+        copy->as_memo = malloc(size);
+        if(copy->as_memo) {
+            memcpy(copy->as_memo, memo, size);
+            copy->as_memo->buckets = malloc(memo->count_buckets * sizeof(size_t));
+            if(copy->as_memo->buckets) memcpy(copy->as_memo->buckets, memo->buckets, memo->count_buckets * sizeof(size_t));
+        }
+        ok = copy->as_memo && copy->as_memo->buckets;
+        if(copy->as_memo && !ok) free(copy->as_memo);
+    } else if(obj->type == YUE_OBJECT_BATCH) {
+        const yue_Batch *batch = obj->as_batch;
+        yue_Batch *dst = calloc(1, sizeof(yue_Batch));
+        copy->as_batch = dst;
+        if(dst) {
+            dst->count_commands = dst->cap_commands = batch->count_commands;
+            dst->count_values   = dst->cap_values   = batch->count_values;
+            dst->count_strings  = dst->cap_strings  = batch->count_strings;
+            if(batch->count_commands) dst->commands = malloc(batch->count_commands * sizeof(yue_BatchCommand));
+            if(batch->count_values) dst->values = malloc(batch->count_values * sizeof(yue_Value));
+            if(batch->count_strings) dst->strings = malloc(batch->count_strings);
+            ok = (dst->commands || !batch->count_commands) && (dst->values || !batch->count_values) && (dst->strings || !batch->count_strings);
+            if(dst->commands) memcpy(dst->commands, batch->commands, batch->count_commands * sizeof(yue_BatchCommand));
+            if(dst->values) memcpy(dst->values, batch->values, batch->count_values * sizeof(yue_Value));
+            if(dst->strings) memcpy(dst->strings, batch->strings, batch->count_strings);
+            if(!ok) _yue_batch_free(dst);
+        } else {
+            ok = false;
+        }
+    }
+    if(!ok) {
+        copy->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not copy a %s for yue_reset", _yue_type_names[obj->type]);
+    }
+    yue_pushgc(ctx, copy);
+    return copy;
+}
+
+// Puts back in obj what it held when copy was made. Batches only grow their arrays, so
+// they still have room for what they held then
+static void _yue_restore(yue_Object *obj, yue_Object *copy)
+{
+    if(obj->type == YUE_OBJECT_RECORD) {
+        memcpy(obj->as_record->slots, copy->as_record->slots, copy->as_record->count * sizeof(yue_Object*));
+    } else if(obj->type == YUE_OBJECT_MEMO) {
+        yue_Memo *memo = obj->as_memo;
+        size_t *buckets = memo->buckets;
+        memcpy(memo, copy->as_memo, sizeof(yue_Memo) + memo->capacity * sizeof(yue_MemoEntry));
+        memo->buckets = buckets;
+        memcpy(memo->buckets, copy->as_memo->buckets, memo->count_buckets * sizeof(size_t));
+    } else if(obj->type == YUE_OBJECT_BATCH) {
+        yue_Batch *batch = obj->as_batch, *src = copy->as_batch;
+        assert(batch->cap_commands >= src->count_commands && batch->cap_values >= src->count_values && batch->cap_strings >= src->count_strings);
+        batch->count_commands = src->count_commands;
+        batch->count_values   = src->count_values;
+        batch->count_strings  = src->count_strings;
+        if(src->count_commands) memcpy(batch->commands, src->commands, src->count_commands * sizeof(yue_BatchCommand));
+        if(src->count_values) memcpy(batch->values, src->values, src->count_values * sizeof(yue_Value));
+        if(src->count_strings) memcpy(batch->strings, src->strings, src->count_strings);
+    }
+}
+
+void yue_markbase(yue_Context *ctx)
+{
+    size_t gc = yue_savegc(ctx);
+    ctx->base.bindings  = NULL;
+    ctx->base.snapshots = NULL;
+    yue_Object *bindings = yue_nil(ctx);
+    for(yue_Object *sym = ctx->scope[0]; sym; sym = sym->next) {
+        bindings = yue_pair(ctx, yue_pair(ctx, sym, sym->as_symbol.value), bindings);
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, bindings);
+    }
+
+    // scripts can change records, memos and batches after the base, only the live ones are
+    // copied so that none of them is collected while the copies are made
+    yue_rungc(ctx);
+    size_t count_objects = ctx->fresh_objects;
+    yue_Object *snapshots = yue_nil(ctx);
+    for(size_t i = 0; i < count_objects; ++i) {
+        yue_Object *obj = &ctx->objects[i];
+        bool changes = obj->type == YUE_OBJECT_MEMO || obj->type == YUE_OBJECT_BATCH
+            || (obj->type == YUE_OBJECT_RECORD && obj->as_record->kind == YUE_RECORD_INSTANCE);
+        if(obj->type == YUE_OBJECT_COROUTINE) obj->as_coroutine->before_base = true;
+        if(!changes) continue;
+        snapshots = yue_pair(ctx, yue_pair(ctx, obj, yue_nil(ctx)), snapshots);
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, bindings);
+        yue_pushgc(ctx, snapshots);
+    }
+    // the pairs above are never copied themselves, the copies go in their tails
+    for(yue_Object *curr = snapshots; !yue_isnil(curr); curr = curr->as_pair.tail) {
+        yue_Object *snapshot = curr->as_pair.head;
+        snapshot->as_pair.tail = _yue_snapshot(ctx, snapshot->as_pair.head);
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, bindings);
+        yue_pushgc(ctx, snapshots);
+    }
+    yue_restoregc(ctx, gc);
+    ctx->base.bindings      = bindings;
+    ctx->base.snapshots     = snapshots;
+    ctx->base.globals       = ctx->scope[0];
+    ctx->base.modules       = ctx->modules;
+    ctx->base.plugins       = ctx->plugins;
+    ctx->base.stack_size    = ctx->stack_size;
+    ctx->base.fresh_objects = ctx->fresh_objects;
+}
+
+// Destroys the resources and frees the coroutines and sequences of objects[from..fresh_objects]
+static void _yue_destroy_objects(yue_Context *ctx, size_t from)
+{
+#if defined(__linux__)
+    // parked tasks are dropped, their fds are closed with the other resources
+    if(ctx->loop) _yue_loop_close(ctx);
+#endif
+    for(size_t i = from; i < ctx->fresh_objects; ++i) {
+        yue_Object *obj = &ctx->objects[i];
+        if(obj->type == YUE_OBJECT_RESOURCE) {
+            obj->as_resource.destroy(obj->as_resource.data);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_COROUTINE) {
+            free(obj->as_coroutine);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_SEQ) {
+            _yue_seq_free(obj->as_seq);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_MEMO) {
+            _yue_memo_free(obj->as_memo);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_BATCH) {
+            _yue_batch_free(obj->as_batch);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_MODULE) {
+            free(obj->as_module);
+            obj->type = YUE_OBJECT_NIL;
+        } else if(obj->type == YUE_OBJECT_RECORD) {
+            free(obj->as_record);
+            obj->type = YUE_OBJECT_NIL;
+        }
+    }
+}
+
+void yue_reset(yue_Context *ctx)
+{
+    // objects that were live before the base may have been freed and reused, those
+    // are not touched here and will be found by the next collection
+    _yue_destroy_objects(ctx, ctx->base.fresh_objects);
+
+    ctx->stack         = ctx->stack_base;
+    ctx->scope         = ctx->scope_base;
+    ctx->coroutine     = NULL;
+    ctx->jump          = NULL;
+    ctx->module        = NULL;
+    ctx->module_scope  = 0;
+    ctx->scope_size    = 1;
+    ctx->scope[0]      = ctx->base.globals;
+    ctx->stack_size    = ctx->base.stack_size;
+    ctx->fresh_objects = ctx->base.fresh_objects;
+    ctx->free_list     = NULL;
+
+    // globals may be reassigned by scripts
+    yue_Object *bindings = ctx->base.bindings;
+    while(bindings && !yue_isnil(bindings)) {
+        yue_Object *binding = bindings->as_pair.head;
+        binding->as_pair.head->as_symbol.value = binding->as_pair.tail;
+        bindings = bindings->as_pair.tail;
+    }
+    // and the records, memos and batches from before the base may hold objects made after it
+    for(yue_Object *curr = ctx->base.snapshots; curr && !yue_isnil(curr); curr = curr->as_pair.tail) {
+        _yue_restore(curr->as_pair.head->as_pair.head, curr->as_pair.head->as_pair.tail);
+    }
+    // modules required before the base are loaded again when they're used,
+    // their bindings may be objects made after it
+    ctx->plugins = ctx->base.plugins;
+    ctx->modules = ctx->base.modules;
+    for(yue_Object *module = ctx->modules; module; module = module->as_module->next) {
+        module->as_module->state    = YUE_MODULE_UNLOADED;
+        module->as_module->bindings = NULL;
+    }
+}
+
+void yue_close(yue_Context *ctx)
+{
+    _yue_destroy_objects(ctx, 0);
+}
+
+size_t yue_pool_init(yue_Pool *pool, void *buf, size_t bufsz, size_t ctxsz, void (*setup)(yue_Context *ctx))
+{
+    size_t align = sizeof(yue_Object*) * 2;
+    ctxsz = (ctxsz + align - 1) & ~(align - 1);
+    pool->count_free = 0;
+    while(bufsz >= ctxsz && pool->count_free < YUE_POOL_CAP) {
+        yue_Context *ctx = yue_open(buf, ctxsz);
+        yue_load_builtins(ctx);
+        if(setup) setup(ctx);
+        yue_markbase(ctx);
+        pool->free[pool->count_free++] = ctx;
+        buf    = (char*)buf + ctxsz;
+        bufsz -= ctxsz;
+    }
+    return pool->count_free;
+}
+
+yue_Context *yue_pool_acquire(yue_Pool *pool)
+{
+    if(pool->count_free == 0) return NULL;
+    return pool->free[--pool->count_free];
+}
+
+void yue_pool_release(yue_Pool *pool, yue_Context *ctx)
+{
+    assert(pool->count_free < YUE_POOL_CAP && "Releasing a context that is not from this pool");
+    yue_reset(ctx);
+    pool->free[pool->count_free++] = ctx;
+}
+
+static inline bool _isdigit(int c) { return '0' <= c && c <= '9'; }
+static inline bool _isspace(int c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static yue_Object *_yue_read_form(yue_Context *ctx, yue_File *source)
+{
+    while(_isspace(*source->ptr)) source->ptr++;
+    if(source->ptr >= source->eof) return yue_nil(ctx);
+    if(*source->ptr == '"') {
+        source->ptr++;
+        const char *start = source->ptr;
+        while(source->ptr < source->eof && *source->ptr != '"') source->ptr++;
+        size_t size = source->ptr - start;
+        source->ptr++;
+        return yue_string_sized(ctx, start, size);
+    } else if(_isdigit(*source->ptr)) {
+        yue_Number val = 0;
+        while(source->ptr < source->eof) {
+            if(_isdigit(*source->ptr)) {
+                val *= 10;
+                val += *source->ptr - '0';
+                source->ptr++;
+            } else {
+                break;
+            }
+        }
+        return yue_number(ctx, val);
+    } else if(*source->ptr == '(') {
+        source->ptr++;
+        while(_isspace(*source->ptr)) source->ptr++;
+        if(source->ptr < source->eof && *source->ptr == ')') {
+            source->ptr++; // empty list
+            return yue_nil(ctx);
+        }
+
+        size_t gc = yue_savegc(ctx);
+        yue_Object *r =  _yue_read_form(ctx, source);
+        yue_Object *root = yue_pair(ctx, r, yue_nil(ctx));
+        yue_Object *prev = root;
+        for(;;) {
+            while(source->ptr < source->eof && _isspace(*source->ptr)) source->ptr++;
+            if(source->ptr >= source->eof) yue_error(ctx, "Unclosed '('");
+            if(*source->ptr == ')') {
+                source->ptr++;
+                break;
+            }
+            yue_Object *r = _yue_read_form(ctx, source);
+            yue_Object *curr = yue_pair(ctx, r, yue_nil(ctx));
+            prev->as_pair.tail = curr;
+            prev = curr;
+            // everything so far is reachable from root
+            yue_restoregc(ctx, gc);
+            yue_pushgc(ctx, root);
+        }
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, root);
+        return root;
+    } else {
+        size_t i = 0;
+        char name[YUE_STRING_DATA_SIZE] = {0};
+        memset(name, 0, YUE_STRING_DATA_SIZE);
+        while(source->ptr < source->eof) {
+            if(_isspace(*source->ptr)) break;
+            if(*source->ptr == '(' || *source->ptr == ')') break;
+            if(i + 1 >= YUE_STRING_DATA_SIZE) yue_error(ctx, "symbol name is too long");
+            name[i] = *source->ptr;
+            i++;
+            source->ptr++;
+        }
+        name[YUE_STRING_DATA_SIZE-1] = 0;
+        return yue_symbol(ctx, name);
+    }
+
+    return yue_nil(ctx);
+}
+
+yue_Object *yue_read(yue_Context *ctx, yue_File *source)
+{
+    yue_Object *obj = _yue_read_form(ctx, source);
+    if(ctx->count_macros == 0) return obj;
+    return _yue_macroexpand(ctx, obj);
+}
+
+yue_Code *yue_code_open(void *buf, size_t bufsz)
+{
+    size_t align = sizeof(yue_Object*) * 2;
+    size_t header = (sizeof(yue_Code) + align - 1) & ~(align - 1);
+    yue_Code *code = buf;
+    atomic_init(&code->refs, 1);
+    code->ctx   = yue_open((char*)buf + header, bufsz - header);
+    code->forms = yue_pair(code->ctx, yue_nil(code->ctx), yue_nil(code->ctx));
+    code->last  = code->forms;
+    code->lines = NULL;
+    code->count_lines = code->cap_lines = 0;
+    code->name[0] = 0;
+    return code;
+}
+
+void yue_code_setname(yue_Code *code, const char *name)
+{
+    snprintf(code->name, sizeof(code->name), "%s", name);
+}
+
+yue_Status yue_code_load(yue_Code *code, yue_File *file)
+{
+    yue_Context *ctx = code->ctx;
+    size_t gc = yue_savegc(ctx);
+    size_t line = 1;
+    for(const char *c = file->fst; c < file->ptr; ++c) line += *c == '\n';
+    for(;;) {
+        yue_restoregc(ctx, gc);
+        // lines are counted up to where the next form starts
+        while(file->ptr < file->eof && _isspace(*file->ptr)) {
+            line += *file->ptr == '\n';
+            file->ptr++;
+        }
+        const char *start = file->ptr;
+        yue_Object *obj = NULL;
+        yue_Status status = yue_pread(ctx, file, &obj);
+        if(status != YUE_OK) return status;
+        if(yue_isnil(obj)) break;
+        // macros are defined while loading so the forms after them are stored expanded,
+        // they're defined again when the code runs
+        if(obj->type == YUE_OBJECT_PAIR && _yue_issymbol(obj->as_pair.head, "defmacro")) {
+            if(ctx->count_macros == 0) yue_load_builtins(ctx);
+            status = yue_peval(ctx, obj, NULL);
+            if(status != YUE_OK) return status;
+        }
+        if(code->count_lines == code->cap_lines) {
+            size_t cap = code->cap_lines ? code->cap_lines * 2 : 64;
+            size_t *lines = realloc(code->lines, cap * sizeof(*lines));
+            if(!lines) {
+                snprintf(ctx->error, sizeof(ctx->error), "Could not allocate the lines of %zu forms", cap);
+                return YUE_ERROR;
+            }
+            code->lines = lines;
+            code->cap_lines = cap;
+        }
+        yue_Object *form = yue_pair(ctx, obj, yue_nil(ctx));
+        code->last->as_pair.tail = form;
+        code->last = form;
+        code->lines[code->count_lines++] = line;
+        for(const char *c = start; c < file->ptr; ++c) line += *c == '\n';
+    }
+    yue_restoregc(ctx, gc);
+    return YUE_OK;
+}
+
+const char *yue_code_geterror(yue_Code *code)
+{
+    return yue_geterror(code->ctx);
+}
+
+void yue_code_retain(yue_Code *code)
+{
+    atomic_fetch_add(&code->refs, 1);
+}
+
+bool yue_code_release(yue_Code *code)
+{
+    return atomic_fetch_sub(&code->refs, 1) == 1;
+}
+
+void yue_code_close(yue_Code *code)
+{
+    free(code->lines);
+    code->lines = NULL;
+    code->count_lines = code->cap_lines = 0;
+}
+
+yue_Status yue_code_run(yue_Context *ctx, yue_Code *code, yue_Object **result)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = yue_nil(ctx);
+    yue_Object *form = code->forms->as_pair.tail;
+    for(size_t i = 0; form->type == YUE_OBJECT_PAIR; ++i) {
+        size_t line = code->lines[i];
+        yue_restoregc(ctx, gc);
+        if(ctx->heap_profile && ctx->heap_profile->running) _yue_heap_form(ctx, code, line);
+        yue_CounterSet counted;
+        bool counting = ctx->counters && ctx->counters->running;
+        if(counting) yue_counters_begin(ctx, &counted);
+        yue_Status status;
+        if(ctx->profile && ctx->profile->running) {
+            yue_ProfileForm profiled = {code, form->as_pair.head, line};
+            status = _yue_protect(ctx, _yue_profile_form, &profiled, &res);
+        } else {
+            status = yue_peval(ctx, form->as_pair.head, &res);
+        }
+        if(counting && ctx->counters && ctx->counters->running) {
+            yue_counters_end(ctx, &counted);
+            _yue_counters_form(ctx, code, line, &counted);
+        }
+        if(status != YUE_OK) {
+            if(result) *result = res;
+            return status;
+        }
+        form = form->as_pair.tail;
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    if(result) *result = res;
+    return YUE_OK;
+}
+
+/////////////////////////
+///
+/// Tasks
+///
+
+struct yue_Task {
+    yue_Task *next;
+    yue_Context *ctx;
+    yue_Code *code;
+    yue_Fiber fiber;
+    // whoever resumed the task
+    yue_Fiber caller;
+    bool done;
+    yue_Status status;
+};
+
+static void _yue_task_main(void *arg)
+{
+    yue_Task *task = arg;
+    task->status = yue_code_run(task->ctx, task->code, NULL);
+    task->done   = true;
+    _yue_fiber_switch(&task->fiber, &task->caller);
+}
+
+static void _yue_task_yield(yue_Task *task)
+{
+    _yue_fiber_switch(&task->fiber, &task->caller);
+}
+
+static void _yue_task_resume(yue_Task *task)
+{
+    yue_Task *prev = task->ctx->task;
+    task->ctx->task = task;
+    _yue_fiber_switch(&task->caller, &task->fiber);
+    task->ctx->task = prev;
+}
+
+yue_Task *yue_task_open(void *buf, size_t bufsz, yue_Context *ctx, yue_Code *code)
+{
+    size_t align  = 16;
+    size_t header = (sizeof(yue_Task) + align - 1) & ~(align - 1);
+    if(bufsz <= header) return NULL;
+    yue_Task *task = buf;
+    memset(task, 0, sizeof(*task));
+    task->ctx  = ctx;
+    task->code = code;
+    if(!_yue_fiber_init(&task->fiber, (char*)buf + header, bufsz - header, _yue_task_main, task))
+        return NULL;
+    return task;
+}
+
+bool yue_task_done(yue_Task *task)
+{
+    return task->done;
+}
+
+yue_Status yue_task_status(yue_Task *task)
+{
+    return task->status;
+}
+
+yue_Context *yue_task_context(yue_Task *task)
+{
+    return task->ctx;
+}
+
+void yue_sched_init(yue_Scheduler *sched, long slice)
+{
+    sched->head  = NULL;
+    sched->tail  = NULL;
+    sched->slice = slice > 0 ? slice : 1;
+}
+
+void yue_sched_add(yue_Scheduler *sched, yue_Task *task)
+{
+    task->next = NULL;
+    if(sched->tail) {
+        sched->tail->next = task;
+    } else {
+        sched->head = task;
+    }
+    sched->tail = task;
+}
+
+bool yue_sched_step(yue_Scheduler *sched)
+{
+    yue_Task *task = sched->head;
+    if(!task) return false;
+    sched->head = task->next;
+    if(!sched->head) sched->tail = NULL;
+
+    yue_setfuel(task->ctx, sched->slice);
+    _yue_task_resume(task);
+    if(task->done) {
+        yue_setfuel(task->ctx, -1);
+    } else {
+        yue_sched_add(sched, task);
+    }
+    return true;
+}
+
+void yue_sched_run(yue_Scheduler *sched)
+{
+    while(yue_sched_step(sched));
+}
+
+/////////////////////////
+///
+/// Coroutines
+///
+
+static yue_Object *_yue_coroutine_body(yue_Context *ctx, void *arg)
+{
+    yue_Coroutine *co = arg;
+    return yue_call(ctx, co->fn, co->value);
+}
+
+static void _yue_coroutine_main(void *arg)
+{
+    yue_Coroutine *co = arg;
+    yue_Context *ctx = co->ctx;
+    yue_Object *res = NULL;
+    co->status = _yue_protect(ctx, _yue_coroutine_body, co, &res);
+    co->value  = res;
+    co->state  = YUE_COROUTINE_DEAD;
+    _yue_fiber_switch(&co->fiber, &co->caller);
+}
+
+static void _yue_swap_frame(yue_Context *ctx, yue_Frame *frame)
+{
+    yue_Frame saved = {
+        .stack      = ctx->stack,
+        .stack_size = ctx->stack_size,
+        .scope      = ctx->scope,
+        .scope_size = ctx->scope_size,
+        .jump       = ctx->jump,
+        .coroutine  = ctx->coroutine,
+        .module       = ctx->module,
+        .module_scope = ctx->module_scope,
+    };
+    // the global scope is shared, new globals may have been added on the other side
+    frame->scope[0] = ctx->scope[0];
+    ctx->stack      = frame->stack;
+    ctx->stack_size = frame->stack_size;
+    ctx->scope      = frame->scope;
+    ctx->scope_size = frame->scope_size;
+    ctx->jump       = frame->jump;
+    ctx->coroutine  = frame->coroutine;
+    ctx->module       = frame->module;
+    ctx->module_scope = frame->module_scope;
+    *frame = saved;
+}
+
+static void _yue_coroutine_resume(yue_Context *ctx, yue_Coroutine *co)
+{
+    if(!co->started) {
+        co->started = true;
+        if(!_yue_fiber_init(&co->fiber, co->cstack, YUE_COROUTINE_STACK, _yue_coroutine_main, co))
+            yue_error(ctx, "Could not start a coroutine");
+    }
+    co->state = YUE_COROUTINE_RUNNING;
+    _yue_swap_frame(ctx, &co->frame);
+    ctx->coroutine = co;
+    _yue_fiber_switch(&co->caller, &co->fiber);
+    _yue_swap_frame(ctx, &co->frame);
+    if(co->state == YUE_COROUTINE_RUNNING) co->state = YUE_COROUTINE_SUSPENDED;
+}
+
+// (coroutine fn)
+yue_Object *yue_builtin_coroutine(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(!_yue_callable(fn)) 
+        yue_error(ctx, "`coroutine` requires a function but found %s", _yue_type_names[fn->type]);
+    yue_pushgc(ctx, fn);
+    // the object comes first so that the stack isn't leaked when the heap is full
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_COROUTINE);
+    yue_Coroutine *co = malloc(sizeof(yue_Coroutine) + YUE_COROUTINE_STACK);
+    if(!co) {
+        obj->type = YUE_OBJECT_NIL;
+        yue_error(ctx, "Could not allocate a coroutine");
+    }
+    memset(co, 0, sizeof(*co));
+    co->ctx   = ctx;
+    co->fn    = fn;
+    co->value = yue_nil(ctx);
+    co->state = YUE_COROUTINE_SUSPENDED;
+    co->frame.stack      = co->stack;
+    co->frame.stack_size = 0;
+    co->frame.scope      = co->scope;
+    co->frame.scope_size = 1;
+    obj->as_coroutine = co;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// (resume co args...)
+// The first resume calls the coroutine's function with args, the next ones
+// make `yield` return the first arg. Returns what's yielded or returned.
+yue_Object *yue_builtin_resume(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(obj->type != YUE_OBJECT_COROUTINE) 
+        yue_error(ctx, "`resume` requires a coroutine but found %s", _yue_type_names[obj->type]);
+    yue_pushgc(ctx, obj);
+    yue_Coroutine *co = obj->as_coroutine;
+    if(co->state == YUE_COROUTINE_DEAD) yue_error(ctx, "Resuming a dead coroutine");
+    if(co->state == YUE_COROUTINE_RUNNING) yue_error(ctx, "Resuming a running coroutine");
+    if(co->ctx != ctx) yue_error(ctx, "Resuming a coroutine of another context");
+    if(co->before_base) yue_error(ctx, "Resuming a coroutine made before the base of the context");
+
+    yue_Object *values = _eval_list(ctx, arg);
+    if(co->started) {
+        co->value = values->type == YUE_OBJECT_PAIR ? values->as_pair.head : yue_nil(ctx);
+    } else {
+        co->value = values;
+    }
+    _yue_coroutine_resume(ctx, co);
+    yue_Object *res = co->value;
+    co->value = yue_nil(ctx);
+    yue_restoregc(ctx, gc);
+    // errors inside the coroutine continue in the resumer
+    if(co->state == YUE_COROUTINE_DEAD && co->status != YUE_OK) _yue_throw(ctx, co->status);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (yield value)
+yue_Object *yue_builtin_yield(yue_Context *ctx, yue_Object *arg)
+{
+    yue_Coroutine *co = ctx->coroutine;
+    if(!co) yue_error(ctx, "`yield` outside of a coroutine");
+    size_t gc = yue_savegc(ctx);
+    co->value = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    _yue_fiber_switch(&co->fiber, &co->caller);
+    yue_Object *res = co->value;
+    co->value = yue_nil(ctx);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+yue_Object *yue_builtin_coroutine_done(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    if(obj->type != YUE_OBJECT_COROUTINE) 
+        yue_error(ctx, "`coroutine-done` requires a coroutine but found %s", _yue_type_names[obj->type]);
+    return obj->as_coroutine->state == YUE_COROUTINE_DEAD ? yue_number(ctx, 1) : yue_nil(ctx);
+}
+
+/////////////////////////
+///
+/// Sequences
+///
+
+yue_Object *yue_seq(yue_Context *ctx, yue_Seq *seq)
+{
+    yue_Object *obj = new_object(ctx, YUE_OBJECT_SEQ);
+    obj->as_seq = seq;
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+static yue_Object *_yue_seq_open(yue_Context *ctx, bool (*next)(yue_Context *ctx, yue_Seq *seq, yue_Object **out))
+{
+    yue_Seq *seq = calloc(1, sizeof(*seq));
+    if(!seq) yue_error(ctx, "Could not allocate a sequence");
+    seq->next = next;
+    return yue_seq(ctx, seq);
+}
+
+// The next element of a sequence object in *out, false once it's exhausted.
+// obj must be rooted by the caller. Pulling changes the sequence, so it has to
+// be one of ctx, pmap workers only read what the caller owns.
+static bool _yue_seq_next(yue_Context *ctx, yue_Object *obj, yue_Object **out)
+{
+    if(!_yue_owns(ctx, obj)) yue_error(ctx, "Pulling from a sequence of another context");
+    yue_Seq *seq = obj->as_seq;
+    if(seq->done) return false;
+    if(seq->next(ctx, seq, out)) return true;
+    seq->done = true;
+    return false;
+}
+
+static bool _yue_seq_list_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    (void)ctx;
+    if(seq->source->type != YUE_OBJECT_PAIR) return false;
+    *out = seq->source->as_pair.head;
+    seq->source = seq->source->as_pair.tail;
+    return true;
+}
+
+static bool _yue_seq_coroutine_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    yue_Coroutine *co = seq->source->as_coroutine;
+    if(co->state == YUE_COROUTINE_DEAD) return false;
+    if(co->state == YUE_COROUTINE_RUNNING) yue_error(ctx, "Pulling from a running coroutine");
+    if(co->ctx != ctx) yue_error(ctx, "Pulling from a coroutine of another context");
+    if(co->before_base) yue_error(ctx, "Pulling from a coroutine made before the base of the context");
+    co->value = yue_nil(ctx);
+    _yue_coroutine_resume(ctx, co);
+    yue_Object *res = co->value;
+    co->value = yue_nil(ctx);
+    if(co->state == YUE_COROUTINE_DEAD) {
+        if(co->status != YUE_OK) _yue_throw(ctx, co->status);
+        // what the function returns isn't part of the sequence
+        return false;
+    }
+    yue_pushgc(ctx, res);
+    *out = res;
+    return true;
+}
+
+static bool _yue_seq_range_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    if(seq->index >= seq->limit) return false;
+    *out = yue_number(ctx, seq->index);
+    seq->index += 1;
+    return true;
+}
+
+// Lists, coroutines and sequences as a sequence object
+static yue_Object *_yue_toseq(yue_Context *ctx, yue_Object *obj, const char *name)
+{
+    yue_Object *res = NULL;
+    switch(obj->type) {
+    case YUE_OBJECT_SEQ:
+        return obj;
+    case YUE_OBJECT_NIL:
+    case YUE_OBJECT_PAIR:
+        res = _yue_seq_open(ctx, _yue_seq_list_next);
+        break;
+    case YUE_OBJECT_COROUTINE:
+        res = _yue_seq_open(ctx, _yue_seq_coroutine_next);
+        break;
+    default:
+        yue_error(ctx, "`%s` requires a list, coroutine or sequence but found %s", name, _yue_type_names[obj->type]);
+    }
+    res->as_seq->source = obj;
+    return res;
+}
+
+typedef struct yue_LineReader {
+    FILE *file;
+    size_t start;
+    size_t end;
+    char buf[YUE_LINE_CAP];
+} yue_LineReader;
+
+static void _yue_lines_destroy(yue_Seq *seq)
+{
+    yue_LineReader *reader = seq->data;
+    if(reader->file) fclose(reader->file);
+    free(reader);
+}
+
+// Lines longer than the buffer come out in pieces of YUE_LINE_CAP bytes
+static bool _yue_lines_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    yue_LineReader *reader = seq->data;
+    for(;;) {
+        char *start = reader->buf + reader->start;
+        char *newline = memchr(start, '\n', reader->end - reader->start);
+        if(newline) {
+            size_t n = newline - start;
+            reader->start += n + 1;
+            if(n > 0 && start[n - 1] == '\r') n -= 1;
+            *out = yue_string_sized(ctx, start, n);
+            return true;
+        }
+        bool full = reader->start == 0 && reader->end == YUE_LINE_CAP;
+        if(full || (!reader->file && reader->start < reader->end)) {
+            *out = yue_string_sized(ctx, start, reader->end - reader->start);
+            reader->start = reader->end = 0;
+            return true;
+        }
+        if(!reader->file) return false;
+        memmove(reader->buf, start, reader->end - reader->start);
+        reader->end  -= reader->start;
+        reader->start = 0;
+        size_t n = fread(reader->buf + reader->end, 1, YUE_LINE_CAP - reader->end, reader->file);
+        reader->end += n;
+        if(n == 0) {
+            // done with the file, no need to wait for the GC to close it
+            fclose(reader->file);
+            reader->file = NULL;
+        }
+    }
+}
+
+static bool _yue_seq_map_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    yue_Object *value = NULL;
+    if(!_yue_seq_next(ctx, seq->source, &value)) return false;
+    *out = yue_call(ctx, seq->fn, yue_pair(ctx, value, yue_nil(ctx)));
+    return true;
+}
+
+static bool _yue_seq_filter_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *value = NULL;
+    while(_yue_seq_next(ctx, seq->source, &value)) {
+        yue_pushgc(ctx, value);
+        yue_Object *keep = yue_call(ctx, seq->fn, yue_pair(ctx, value, yue_nil(ctx)));
+        if(!yue_isnil(keep)) {
+            yue_restoregc(ctx, gc);
+            yue_pushgc(ctx, value);
+            *out = value;
+            return true;
+        }
+        yue_restoregc(ctx, gc);
+    }
+    return false;
+}
+
+static bool _yue_seq_take_next(yue_Context *ctx, yue_Seq *seq, yue_Object **out)
+{
+    if(seq->index >= seq->limit) return false;
+    seq->index += 1;
+    return _yue_seq_next(ctx, seq->source, out);
+}
+
+// Lists are mapped or filtered right away into a new list, anything else lazily
+static yue_Object *_yue_seq_wrap(yue_Context *ctx, yue_Object *arg, const char *name, bool filter)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    if(!_yue_callable(fn)) 
+        yue_error(ctx, "`%s` requires a function but found %s", name, _yue_type_names[fn->type]);
+    yue_Object *source = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, source);
+    yue_Object *res = NULL;
+    if(source->type == YUE_OBJECT_PAIR || source->type == YUE_OBJECT_NIL) {
+        yue_ListBuilder builder;
+        _yue_builder_init(ctx, &builder);
+        for(; source->type == YUE_OBJECT_PAIR; source = source->as_pair.tail) {
+            yue_Object *value = source->as_pair.head;
+            yue_Object *out = yue_call(ctx, fn, yue_pair(ctx, value, yue_nil(ctx)));
+            if(!filter) {
+                _yue_builder_push(ctx, &builder, out);
+            } else if(!yue_isnil(out)) {
+                _yue_builder_push(ctx, &builder, value);
+            } else {
+                yue_restoregc(ctx, builder.gc);
+                yue_pushgc(ctx, builder.root);
+            }
+        }
+        res = builder.root;
+    } else {
+        source = _yue_toseq(ctx, source, name);
+        res = _yue_seq_open(ctx, filter ? _yue_seq_filter_next : _yue_seq_map_next);
+        res->as_seq->source = source;
+        res->as_seq->fn     = fn;
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (seq x), x as a sequence
+yue_Object *yue_builtin_seq(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = _yue_toseq(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "seq");
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (range from to), from, from + 1, ... up to but without to
+yue_Object *yue_builtin_range(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *from = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, from);
+    yue_Object *to = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(from->type != YUE_OBJECT_NUMBER || to->type != YUE_OBJECT_NUMBER) 
+        yue_error(ctx, "`range` requires two numbers");
+    yue_Object *res = _yue_seq_open(ctx, _yue_seq_range_next);
+    res->as_seq->index = from->as_number;
+    res->as_seq->limit = to->as_number;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (lines path), the lines of a file without their line endings
+yue_Object *yue_builtin_lines(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *path = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(path->type != YUE_OBJECT_STRING) yue_error(ctx, "`lines` requires a path");
+    char name[1024];
+    yue_tostring(ctx, path, name, sizeof(name));
+    yue_Object *res = _yue_seq_open(ctx, _yue_lines_next);
+    yue_LineReader *reader = malloc(sizeof(*reader));
+    if(!reader) yue_error(ctx, "Could not allocate a line reader");
+    reader->start = reader->end = 0;
+    reader->file = fopen(name, "rb");
+    res->as_seq->data    = reader;
+    res->as_seq->destroy = _yue_lines_destroy;
+    if(!reader->file) yue_error(ctx, "Could not open '%s'", name);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (map fn s), a list for lists and a sequence otherwise
+yue_Object *yue_builtin_map(yue_Context *ctx, yue_Object *arg)
+{
+    return _yue_seq_wrap(ctx, arg, "map", false);
+}
+
+// (filter fn s), the elements for which fn isn't nil, a list for lists and a sequence otherwise
+yue_Object *yue_builtin_filter(yue_Context *ctx, yue_Object *arg)
+{
+    return _yue_seq_wrap(ctx, arg, "filter", true);
+}
+
+// (take n s), at most the first n elements
+yue_Object *yue_builtin_take(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *count = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(count->type != YUE_OBJECT_NUMBER) yue_error(ctx, "`take` requires a number");
+    yue_pushgc(ctx, count);
+    yue_Object *source = _yue_toseq(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "take");
+    yue_Object *res = _yue_seq_open(ctx, _yue_seq_take_next);
+    res->as_seq->source = source;
+    res->as_seq->limit  = count->as_number;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (reduce fn init s), (fn (fn init e0) e1)...
+yue_Object *yue_builtin_reduce(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    yue_Object *acc = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, acc);
+    yue_Object *source = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, source);
+    // lists are walked directly, without a sequence around them
+    bool list = source->type == YUE_OBJECT_PAIR || source->type == YUE_OBJECT_NIL;
+    if(!list) source = _yue_toseq(ctx, source, "reduce");
+    size_t top = yue_savegc(ctx);
+    yue_Object *value = NULL;
+    for(;;) {
+        if(list) {
+            if(source->type != YUE_OBJECT_PAIR) break;
+            value  = source->as_pair.head;
+            source = source->as_pair.tail;
+        } else if(!_yue_seq_next(ctx, source, &value)) {
+            break;
+        }
+        yue_pushgc(ctx, acc);
+        acc = yue_call(ctx, fn, yue_pair(ctx, acc, yue_pair(ctx, value, yue_nil(ctx))));
+        yue_restoregc(ctx, top);
+        yue_pushgc(ctx, acc);
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, acc);
+    return acc;
+}
+
+// (collect s), the remaining elements as a list
+yue_Object *yue_builtin_collect(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *source = _yue_toseq(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "collect");
+    yue_ListBuilder builder;
+    _yue_builder_init(ctx, &builder);
+    yue_Object *value = NULL;
+    while(_yue_seq_next(ctx, source, &value)) _yue_builder_push(ctx, &builder, value);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, builder.root);
+    return builder.root;
+}
+
+/////////////////////////
+///
+/// Parallel map and reduce
+///
+
+typedef enum {
+    YUE_PARALLEL_MAP,
+    YUE_PARALLEL_REDUCE,
+} yue_ParallelMode;
+
+typedef struct yue_Parallel {
+    yue_ParallelMode mode;
+    yue_Context *caller;
+    yue_Object *fn;
+    // the caller's list as an array
+    yue_Object **items;
+    size_t count_items;
+    size_t chunk;
+    atomic_size_t next;
+    atomic_bool failed;
+    // the caller's fuel the workers draw from
+    atomic_long fuel;
+    // one per item for map, one per chunk for reduce. They live in the
+    // heap of the worker that produced them.
+    yue_Object **results;
+    yue_Context **owners;
+    size_t count_results;
+    char error[YUE_ERROR_CAP];
+} yue_Parallel;
+
+typedef struct yue_Worker {
+    yue_Parallel *job;
+    yue_Context *ctx;
+    yue_Thread thread;
+} yue_Worker;
+
+void yue_setworkers(yue_Context *ctx, int count)
+{
+    ctx->workers = count;
+}
+
+static int _yue_count_cores(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static bool _yue_thread_start(yue_Thread *thread, YUE_THREAD_PROC (*proc)(void *arg), void *arg)
+{
+#if defined(_WIN32)
+    *thread = CreateThread(NULL, 0, proc, arg, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, proc, arg) == 0;
+#endif
+}
+
+static void _yue_thread_join(yue_Thread thread)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// Copies what from owns into ctx's heap, everything else (objects of the caller
+// or of a code segment) is shared
+static yue_Object *_yue_copy(yue_Context *ctx, yue_Context *from, yue_Object *obj)
+{
+    if(obj->type == YUE_OBJECT_NIL) return yue_nil(ctx);
+    // small integers live in their context, not in its heap
+    if(obj->type == YUE_OBJECT_NUMBER) return yue_number(ctx, obj->as_number);
+    if(!_yue_owns(from, obj)) return obj;
+    size_t gc = yue_savegc(ctx);
+    yue_Object *res = NULL;
+    switch(obj->type) {
+    case YUE_OBJECT_SYMBOL:
+        res = yue_symbol(ctx, obj->as_symbol.name);
+        break;
+    case YUE_OBJECT_CFUNC:
+        res = yue_cfunc(ctx, obj->as_cfunc);
+        break;
+    case YUE_OBJECT_NATIVE:
+        res = _yue_native(ctx, obj->as_native);
+        break;
+    case YUE_OBJECT_USERDATA:
+        res = yue_userdata(ctx, obj->as_userdata);
+        break;
+    case YUE_OBJECT_RESOURCE:
+        // moved, from won't destroy it anymore
+        res = yue_resource(ctx, obj->as_resource.data, obj->as_resource.destroy);
+        obj->type = YUE_OBJECT_NIL;
+        break;
+    case YUE_OBJECT_COROUTINE:
+        yue_error(ctx, "A coroutine can't be moved to another context");
+        break;
+    case YUE_OBJECT_MEMO:
+        yue_error(ctx, "A memo can't be moved to another context");
+        break;
+    case YUE_OBJECT_BATCH:
+        yue_error(ctx, "A batch can't be moved to another context");
+        break;
+    case YUE_OBJECT_MODULE:
+        yue_error(ctx, "A module can't be moved to another context");
+        break;
+    case YUE_OBJECT_RECORD:
+        {
+            yue_Record *record = obj->as_record;
+            yue_Object *type = _yue_copy(ctx, from, record->type);
+            yue_pushgc(ctx, type);
+            res = _yue_record_open(ctx, record->kind, type, record->count);
+            res->as_record->index = record->index;
+            for(size_t i = 0; i < record->count; ++i) res->as_record->slots[i] = _yue_copy(ctx, from, record->slots[i]);
+        } break;
+    case YUE_OBJECT_FUNC:
+    case YUE_OBJECT_MACRO:
+        {
+            if(obj->as_func.module) yue_error(ctx, "A function of a module can't be moved to another context");
+            yue_Object *params = _yue_copy(ctx, from, obj->as_func.params);
+            yue_Object *body   = _yue_copy(ctx, from, obj->as_func.body);
+            res = yue_func(ctx, params, body);
+            res->type = obj->type;
+        } break;
+    case YUE_OBJECT_STRING:
+        {
+            yue_Object *prev = NULL;
+            for(; obj; obj = obj->as_str.tail) {
+                yue_Object *curr = new_object(ctx, YUE_OBJECT_STRING);
+                memcpy(curr->as_str.data, obj->as_str.data, YUE_STRING_DATA_SIZE);
+                curr->as_str.tail = NULL;
+                if(prev) {
+                    prev->as_str.tail = curr;
+                } else {
+                    res = curr;
+                    yue_pushgc(ctx, res);
+                }
+                prev = curr;
+            }
+        } break;
+    case YUE_OBJECT_PAIR:
+        {
+            yue_Object *prev = NULL;
+            while(obj->type == YUE_OBJECT_PAIR && _yue_owns(from, obj)) {
+                yue_Object *curr = yue_pair(ctx, _yue_copy(ctx, from, obj->as_pair.head), yue_nil(ctx));
+                if(prev) {
+                    prev->as_pair.tail = curr;
+                } else {
+                    res = curr;
+                }
+                prev = curr;
+                obj = obj->as_pair.tail;
+                yue_restoregc(ctx, gc);
+                yue_pushgc(ctx, res);
+            }
+            prev->as_pair.tail = _yue_copy(ctx, from, obj);
+        } break;
+    default:
+        assert(false && "Unreachable");
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+static yue_Object *_yue_parallel_body(yue_Context *ctx, void *arg)
+{
+    yue_Parallel *job = arg;
+    // every result stays reachable from here until the caller has copied them
+    yue_Object *keep = yue_pair(ctx, yue_nil(ctx), yue_nil(ctx));
+    size_t gc = yue_savegc(ctx);
+    while(!atomic_load(&job->failed)) {
+        size_t start = atomic_fetch_add(&job->next, job->chunk);
+        if(start >= job->count_items) break;
+        size_t end = start + job->chunk < job->count_items ? start + job->chunk : job->count_items;
+        yue_Object *res = NULL;
+        if(job->mode == YUE_PARALLEL_MAP) {
+            for(size_t i = start; i < end; ++i) {
+                res = yue_call(ctx, job->fn, yue_pair(ctx, job->items[i], yue_nil(ctx)));
+                job->results[i] = res;
+                job->owners[i]  = ctx;
+                keep->as_pair.tail = yue_pair(ctx, res, keep->as_pair.tail);
+                yue_restoregc(ctx, gc);
+            }
+        } else {
+            res = job->items[start];
+            for(size_t i = start + 1; i < end; ++i) {
+                yue_pushgc(ctx, res);
+                yue_Object *args = yue_pair(ctx, res, yue_pair(ctx, job->items[i], yue_nil(ctx)));
+                res = yue_call(ctx, job->fn, args);
+                yue_restoregc(ctx, gc);
+            }
+            job->results[start / job->chunk] = res;
+            job->owners[start / job->chunk]  = ctx;
+            keep->as_pair.tail = yue_pair(ctx, res, keep->as_pair.tail);
+            yue_restoregc(ctx, gc);
+        }
+    }
+    return yue_nil(ctx);
+}
+
+static YUE_THREAD_PROC _yue_parallel_worker(void *arg)
+{
+    yue_Worker *worker = arg;
+    yue_Parallel *job = worker->job;
+    if(_yue_protect(worker->ctx, _yue_parallel_body, job, NULL) != YUE_OK) {
+        bool expected = false;
+        // only the first error is reported
+        if(atomic_compare_exchange_strong(&job->failed, &expected, true)) 
+            memcpy(job->error, worker->ctx->error, YUE_ERROR_CAP);
+    }
+    return 0;
+}
+
+// The results in order, copied into the caller's heap
+static yue_Object *_yue_parallel_collect(yue_Context *ctx, void *arg)
+{
+    yue_Parallel *job = arg;
+    size_t gc = yue_savegc(ctx);
+    yue_Object *root = yue_nil(ctx);
+    yue_Object *prev = NULL;
+    for(size_t i = 0; i < job->count_results; ++i) {
+        yue_Object *curr = yue_pair(ctx, _yue_copy(ctx, job->owners[i], job->results[i]), yue_nil(ctx));
+        if(prev) {
+            prev->as_pair.tail = curr;
+        } else {
+            root = curr;
+        }
+        prev = curr;
+        yue_restoregc(ctx, gc);
+        yue_pushgc(ctx, root);
+    }
+    return root;
+}
+
+static yue_Object *_yue_parallel(yue_Context *ctx, yue_ParallelMode mode, yue_Object *fn, yue_Object *list)
+{
+    const char *name = mode == YUE_PARALLEL_MAP ? "pmap" : "preduce";
+    if(!_yue_callable(fn)) 
+        yue_error(ctx, "`%s` requires a function but found %s", name, _yue_type_names[fn->type]);
+    if(list->type != YUE_OBJECT_PAIR && list->type != YUE_OBJECT_NIL) 
+        yue_error(ctx, "`%s` requires a list but found %s", name, _yue_type_names[list->type]);
+
+    yue_Parallel job = { .mode = mode, .caller = ctx, .fn = fn };
+    for(yue_Object *it = list; it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) job.count_items += 1;
+    if(job.count_items == 0) return yue_nil(ctx);
+
+    size_t count_workers = ctx->workers > 0 ? (size_t)ctx->workers : (size_t)_yue_count_cores();
+    if(count_workers > job.count_items) count_workers = job.count_items;
+    // a few chunks per worker so that uneven items are balanced
+    job.chunk = job.count_items / (count_workers * 4);
+    if(job.chunk == 0) job.chunk = 1;
+    job.count_results = mode == YUE_PARALLEL_MAP ? job.count_items : (job.count_items + job.chunk - 1) / job.chunk;
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+
+    // every worker's heap is as big as the caller's
+    size_t heap_size = (char*)(ctx->objects + ctx->count_objects) - (char*)ctx;
+    job.items   = malloc(job.count_items * sizeof(yue_Object*));
+    job.results = calloc(job.count_results, sizeof(yue_Object*));
+    job.owners  = calloc(job.count_results, sizeof(yue_Context*));
+    yue_Worker *workers = calloc(count_workers, sizeof(yue_Worker));
+    if(!job.items || !job.results || !job.owners || !workers) {
+        free(job.items);
+        free(job.results);
+        free(job.owners);
+        free(workers);
+        yue_error(ctx, "Could not allocate `%s` workers", name);
+    }
+    size_t i = 0;
+    for(yue_Object *it = list; it->type == YUE_OBJECT_PAIR; it = it->as_pair.tail) job.items[i++] = it->as_pair.head;
+
+    // workers draw from what's left of the caller's fuel as they go. A task's fuel is only
+    // its time slice, there the workers aren't limited but what they use is charged all the same.
+    long pool = ctx->task ? LONG_MAX : ctx->fuel;
+    atomic_init(&job.fuel, pool);
+
+    size_t count_started = 0;
+    for(; count_started < count_workers; ++count_started) {
+        yue_Worker *worker = &workers[count_started];
+        void *buf = malloc(heap_size);
+        if(!buf) break;
+        worker->job = &job;
+        worker->ctx = yue_open(buf, heap_size);
+        // sees the same bindings as fn would have in the caller
+        memcpy(worker->ctx->scope, ctx->scope, ctx->scope_size * sizeof(yue_Object*));
+        worker->ctx->scope_size = ctx->scope_size;
+        worker->ctx->plugins    = ctx->plugins;
+        worker->ctx->builtins   = ctx->builtins;
+        worker->ctx->io         = ctx->io;
+        if(ctx->metered) {
+            yue_setfuel(worker->ctx, 0);
+            worker->ctx->fuel_pool = &job.fuel;
+        }
+        if(!_yue_thread_start(&worker->thread, _yue_parallel_worker, worker)) {
+            free(buf);
+            break;
+        }
+    }
+    if(count_started == 0) {
+        free(job.items);
+        free(job.results);
+        free(job.owners);
+        free(workers);
+        yue_error(ctx, "Could not start `%s` workers", name);
+    }
+    for(size_t i = 0; i < count_started; ++i) _yue_thread_join(workers[i].thread);
+    if(ctx->metered) {
+        long used = pool - atomic_load(&job.fuel);
+        for(size_t i = 0; i < count_started; ++i) used -= workers[i].ctx->fuel;
+        ctx->fuel = used < ctx->fuel ? ctx->fuel - used : 0;
+    }
+
+    yue_Status status = job.failed ? YUE_ERROR : YUE_OK;
+    yue_Object *res = NULL;
+    if(status == YUE_OK) {
+        // copying may run out of memory too, the workers are cleaned up before raising
+        status = _yue_protect(ctx, _yue_parallel_collect, &job, &res);
+        if(status != YUE_OK) memcpy(job.error, ctx->error, YUE_ERROR_CAP);
+    }
+    for(size_t i = 0; i < count_started; ++i) {
+        _yue_destroy_objects(workers[i].ctx, 0);
+        free(workers[i].ctx);
+    }
+    free(job.items);
+    free(job.results);
+    free(job.owners);
+    free(workers);
+    if(status != YUE_OK) yue_error(ctx, "`%s`: %s", name, job.error);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (pmap fn list)
+// The list of (fn item) for every item, computed by worker threads
+yue_Object *yue_builtin_pmap(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    yue_Object *list = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, list);
+    yue_Object *res = _yue_parallel(ctx, YUE_PARALLEL_MAP, fn, list);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (preduce fn init list)
+// fn has to be associative: workers reduce chunks of the list in order, then
+// the caller reduces their results starting from init
+yue_Object *yue_builtin_preduce(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *fn = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, fn);
+    yue_Object *acc = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, acc);
+    yue_Object *list = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, list);
+    yue_Object *partials = _yue_parallel(ctx, YUE_PARALLEL_REDUCE, fn, list);
+    size_t top = yue_savegc(ctx);
+    for(; partials->type == YUE_OBJECT_PAIR; partials = partials->as_pair.tail) {
+        yue_Object *args = yue_pair(ctx, acc, yue_pair(ctx, partials->as_pair.head, yue_nil(ctx)));
+        acc = yue_call(ctx, fn, args);
+        yue_restoregc(ctx, top);
+        yue_pushgc(ctx, acc);
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, acc);
+    return acc;
+}
+
+/////////////////////////
+///
+/// Serialization
+///
+/// "YUE" and a version byte, then the object. Every object starts with a tag:
+/// numbers are 8 little-endian bytes, strings and symbols a varint length and
+/// their bytes, pairs their head then their tail, functions their params then
+/// their body. Strings, symbols, pairs and functions are numbered in the order
+/// they're written, seeing one again writes a reference to its number instead,
+/// which keeps shared structure and cycles.
+///
+
+#define YUE_FORMAT_VERSION 1
+
+enum {
+    YUE_TAG_NIL,
+    YUE_TAG_NUMBER,
+    YUE_TAG_STRING,
+    YUE_TAG_SYMBOL,
+    YUE_TAG_PAIR,
+    YUE_TAG_FUNC,
+    YUE_TAG_REF,
+};
+
+typedef struct yue_Encoder {
+    unsigned char *data;
+    size_t size;
+    size_t cap;
+    // data is reallocated when it's full, otherwise what doesn't fit is only counted
+    bool grow;
+    yue_Object *root;
+    // open addressing, object -> its number + 1
+    yue_Object **keys;
+    size_t *values;
+    size_t count_keys;
+    size_t cap_keys;
+} yue_Encoder;
+
+typedef struct yue_Blob {
+    size_t size;
+    unsigned char data[];
+} yue_Blob;
+
+static void _yue_encode_bytes(yue_Context *ctx, yue_Encoder *enc, const void *bytes, size_t n)
+{
+    if(enc->grow && enc->size + n > enc->cap) {
+        size_t cap = enc->cap ? enc->cap : 256;
+        while(cap < enc->size + n) cap *= 2;
+        unsigned char *data = realloc(enc->data, cap);
+        if(!data) yue_error(ctx, "Could not grow the serialization buffer");
+        enc->data = data;
+        enc->cap  = cap;
+    }
+    if(enc->size + n <= enc->cap) memcpy(enc->data + enc->size, bytes, n);
+    enc->size += n;
+}
+
+static void _yue_encode_byte(yue_Context *ctx, yue_Encoder *enc, unsigned char byte)
+{
+    _yue_encode_bytes(ctx, enc, &byte, 1);
+}
+
+static void _yue_encode_varint(yue_Context *ctx, yue_Encoder *enc, size_t value)
+{
+    while(value >= 0x80) {
+        _yue_encode_byte(ctx, enc, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    _yue_encode_byte(ctx, enc, (unsigned char)value);
+}
+
+static size_t _yue_hash_ptr(const void *ptr)
+{
+    uint64_t x = (uint64_t)(uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+// Writes a reference and returns true when obj was already written, numbers it otherwise
+static bool _yue_encode_seen(yue_Context *ctx, yue_Encoder *enc, yue_Object *obj)
+{
+    if(enc->count_keys * 2 >= enc->cap_keys) {
+        size_t cap = enc->cap_keys ? enc->cap_keys * 2 : 64;
+        yue_Object **keys = calloc(cap, sizeof(*keys));
+        size_t *values = malloc(cap * sizeof(*values));
+        if(!keys || !values) {
+            free(keys);
+            free(values);
+            yue_error(ctx, "Could not grow the serialization table");
+        }
+        for(size_t i = 0; i < enc->cap_keys; ++i) {
+            if(!enc->keys[i]) continue;
+            size_t j = _yue_hash_ptr(enc->keys[i]) & (cap - 1);
+            while(keys[j]) j = (j + 1) & (cap - 1);
+            keys[j]   = enc->keys[i];
+            values[j] = enc->values[i];
+        }
+        free(enc->keys);
+        free(enc->values);
+        enc->keys     = keys;
+        enc->values   = values;
+        enc->cap_keys = cap;
+    }
+    size_t i = _yue_hash_ptr(obj) & (enc->cap_keys - 1);
+    while(enc->keys[i]) {
+        if(enc->keys[i] == obj) {
+            _yue_encode_byte(ctx, enc, YUE_TAG_REF);
+            _yue_encode_varint(ctx, enc, enc->values[i]);
+            return true;
+        }
+        i = (i + 1) & (enc->cap_keys - 1);
+    }
+    enc->keys[i]   = obj;
+    enc->values[i] = enc->count_keys++;
+    return false;
+}
+
+static void _yue_encode(yue_Context *ctx, yue_Encoder *enc, yue_Object *obj)
+{
+    // the tails of lists are written in this loop, only heads recurse
+    for(;;) {
+        switch(obj->type) {
+        case YUE_OBJECT_NIL:
+            _yue_encode_byte(ctx, enc, YUE_TAG_NIL);
+            return;
+        case YUE_OBJECT_NUMBER:
+            {
+                uint64_t bits;
+                memcpy(&bits, &obj->as_number, sizeof(bits));
+                unsigned char bytes[8];
+                for(int i = 0; i < 8; ++i) bytes[i] = (unsigned char)(bits >> (8 * i));
+                _yue_encode_byte(ctx, enc, YUE_TAG_NUMBER);
+                _yue_encode_bytes(ctx, enc, bytes, sizeof(bytes));
+            } return;
+        case YUE_OBJECT_STRING:
+            if(_yue_encode_seen(ctx, enc, obj)) return;
+            _yue_encode_byte(ctx, enc, YUE_TAG_STRING);
+            _yue_encode_varint(ctx, enc, yue_getstringlen(ctx, obj));
+            for(yue_Object *curr = obj; curr; curr = curr->as_str.tail) {
+                size_t n = 0;
+                while(n < YUE_STRING_DATA_SIZE && curr->as_str.data[n]) n += 1;
+                _yue_encode_bytes(ctx, enc, curr->as_str.data, n);
+            }
+            return;
+        case YUE_OBJECT_SYMBOL:
+            if(_yue_encode_seen(ctx, enc, obj)) return;
+            _yue_encode_byte(ctx, enc, YUE_TAG_SYMBOL);
+            _yue_encode_varint(ctx, enc, strlen(obj->as_symbol.name));
+            _yue_encode_bytes(ctx, enc, obj->as_symbol.name, strlen(obj->as_symbol.name));
+            return;
+        case YUE_OBJECT_FUNC:
+            if(_yue_encode_seen(ctx, enc, obj)) return;
+            _yue_encode_byte(ctx, enc, YUE_TAG_FUNC);
+            _yue_encode(ctx, enc, obj->as_func.params);
+            obj = obj->as_func.body;
+            break;
+        case YUE_OBJECT_PAIR:
+            if(_yue_encode_seen(ctx, enc, obj)) return;
+            _yue_encode_byte(ctx, enc, YUE_TAG_PAIR);
+            _yue_encode(ctx, enc, obj->as_pair.head);
+            obj = obj->as_pair.tail;
+            break;
+        default:
+            yue_error(ctx, "Can't serialize %s", _yue_type_names[obj->type]);
+        }
+    }
+}
+
+static yue_Object *_yue_protected_encode(yue_Context *ctx, void *arg)
+{
+    yue_Encoder *enc = arg;
+    _yue_encode_bytes(ctx, enc, "YUE", 3);
+    _yue_encode_byte(ctx, enc, YUE_FORMAT_VERSION);
+    _yue_encode(ctx, enc, enc->root);
+    return NULL;
+}
+
+// Encodes obj, the table is freed whether it succeeds or not
+static void _yue_encode_all(yue_Context *ctx, yue_Encoder *enc, yue_Object *obj)
+{
+    enc->root = obj;
+    yue_Status status = _yue_protect(ctx, _yue_protected_encode, enc, NULL);
+    free(enc->keys);
+    free(enc->values);
+    if(status != YUE_OK) {
+        if(enc->grow) free(enc->data);
+        _yue_throw(ctx, status);
+    }
+}
+
+size_t yue_serialize(yue_Context *ctx, yue_Object *obj, void *dst, size_t dstsz)
+{
+    yue_Encoder enc = { .data = dst, .cap = dst ? dstsz : 0 };
+    _yue_encode_all(ctx, &enc, obj);
+    return enc.size;
+}
+
+typedef struct yue_Decoder {
+    const unsigned char *ptr;
+    const unsigned char *end;
+    // numbered objects in the order they were read
+    yue_Object **objs;
+    size_t count_objs;
+    size_t cap_objs;
+    yue_Object *holder;
+} yue_Decoder;
+
+static unsigned char _yue_decode_byte(yue_Context *ctx, yue_Decoder *dec)
+{
+    if(dec->ptr >= dec->end) yue_error(ctx, "Truncated serialized data");
+    return *dec->ptr++;
+}
+
+static size_t _yue_decode_varint(yue_Context *ctx, yue_Decoder *dec)
+{
+    size_t value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = _yue_decode_byte(ctx, dec);
+        value |= (size_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return value;
+    }
+    yue_error(ctx, "Malformed serialized data");
+    return 0;
+}
+
+static void _yue_decode_remember(yue_Context *ctx, yue_Decoder *dec, yue_Object *obj)
+{
+    if(dec->cap_objs == dec->count_objs) {
+        size_t cap = dec->cap_objs ? dec->cap_objs * 2 : 64;
+        yue_Object **objs = realloc(dec->objs, cap * sizeof(*objs));
+        if(!objs) yue_error(ctx, "Could not grow the deserialization table");
+        dec->objs     = objs;
+        dec->cap_objs = cap;
+    }
+    dec->objs[dec->count_objs++] = obj;
+}
+
+// Decodes into slot, which belongs to an object that's already reachable from
+// the holder so everything decoded so far survives a collection
+static void _yue_decode(yue_Context *ctx, yue_Decoder *dec, yue_Object **slot)
+{
+    size_t gc = yue_savegc(ctx);
+    for(;;) {
+        yue_restoregc(ctx, gc);
+        unsigned char tag = _yue_decode_byte(ctx, dec);
+        switch(tag) {
+        case YUE_TAG_NIL:
+            *slot = yue_nil(ctx);
+            return;
+        case YUE_TAG_NUMBER:
+            {
+                if(dec->end - dec->ptr < 8) yue_error(ctx, "Truncated serialized data");
+                uint64_t bits = 0;
+                for(int i = 0; i < 8; ++i) bits |= (uint64_t)dec->ptr[i] << (8 * i);
+                dec->ptr += 8;
+                yue_Number number;
+                memcpy(&number, &bits, sizeof(number));
+                *slot = yue_number(ctx, number);
+            } break;
+        case YUE_TAG_STRING:
+        case YUE_TAG_SYMBOL:
+            {
+                size_t n = _yue_decode_varint(ctx, dec);
+                if((size_t)(dec->end - dec->ptr) < n) yue_error(ctx, "Truncated serialized data");
+                if(tag == YUE_TAG_STRING) {
+                    *slot = yue_string_sized(ctx, (const char*)dec->ptr, n);
+                } else {
+                    char name[YUE_STRING_DATA_SIZE];
+                    if(n >= sizeof(name)) yue_error(ctx, "Malformed serialized data");
+                    memcpy(name, dec->ptr, n);
+                    name[n] = 0;
+                    *slot = yue_symbol(ctx, name);
+                }
+                dec->ptr += n;
+                _yue_decode_remember(ctx, dec, *slot);
+            } break;
+        case YUE_TAG_REF:
+            {
+                size_t index = _yue_decode_varint(ctx, dec);
+                if(index >= dec->count_objs) yue_error(ctx, "Malformed serialized data");
+                *slot = dec->objs[index];
+            } break;
+        case YUE_TAG_PAIR:
+            {
+                // linked before its fields are read so that they can refer to it
+                yue_Object *pair = yue_pair(ctx, yue_nil(ctx), yue_nil(ctx));
+                *slot = pair;
+                _yue_decode_remember(ctx, dec, pair);
+                _yue_decode(ctx, dec, &pair->as_pair.head);
+                slot = &pair->as_pair.tail;
+            } continue;
+        case YUE_TAG_FUNC:
+            {
+                yue_Object *func = yue_func(ctx, yue_nil(ctx), yue_nil(ctx));
+                *slot = func;
+                _yue_decode_remember(ctx, dec, func);
+                _yue_decode(ctx, dec, &func->as_func.params);
+                slot = &func->as_func.body;
+            } continue;
+        default:
+            yue_error(ctx, "Malformed serialized data");
+        }
+        yue_restoregc(ctx, gc);
+        return;
+    }
+}
+
+static yue_Object *_yue_protected_decode(yue_Context *ctx, void *arg)
+{
+    yue_Decoder *dec = arg;
+    if(dec->end - dec->ptr < 4 || memcmp(dec->ptr, "YUE", 3) != 0) yue_error(ctx, "Not serialized yue data");
+    if(dec->ptr[3] != YUE_FORMAT_VERSION) 
+        yue_error(ctx, "Unsupported serialization format version %d", dec->ptr[3]);
+    dec->ptr += 4;
+    _yue_decode(ctx, dec, &dec->holder->as_pair.head);
+    if(dec->ptr != dec->end) yue_error(ctx, "Trailing bytes after serialized data");
+    return dec->holder->as_pair.head;
+}
+
+yue_Object *yue_deserialize(yue_Context *ctx, const void *src, size_t n)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Decoder dec = { .ptr = src, .end = (const unsigned char*)src + n };
+    dec.holder = yue_pair(ctx, yue_nil(ctx), yue_nil(ctx));
+    yue_Object *res = NULL;
+    yue_Status status = _yue_protect(ctx, _yue_protected_decode, &dec, &res);
+    free(dec.objs);
+    if(status != YUE_OK) _yue_throw(ctx, status);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+static void _yue_blob_destroy(void *data)
+{
+    free(data);
+}
+
+// (serialize obj), a blob resource
+yue_Object *yue_builtin_serialize(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, obj);
+    yue_Object *res = yue_resource(ctx, NULL, _yue_blob_destroy);
+    // room for the blob's header, the size is filled in when it's done
+    yue_Encoder enc = { .grow = true };
+    yue_Blob header = {0};
+    _yue_encode_bytes(ctx, &enc, &header, sizeof(header));
+    _yue_encode_all(ctx, &enc, obj);
+    yue_Blob *blob = (yue_Blob*)enc.data;
+    blob->size = enc.size - sizeof(header);
+    res->as_resource.data = blob;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (deserialize blob)
+yue_Object *yue_builtin_deserialize(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, obj);
+    if(obj->type != YUE_OBJECT_RESOURCE || obj->as_resource.destroy != _yue_blob_destroy)
+        yue_error(ctx, "`deserialize` requires a blob from `serialize`");
+    yue_Blob *blob = obj->as_resource.data;
+    yue_Object *res = yue_deserialize(ctx, blob->data, blob->size);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+#if defined(__linux__)
+
+/////////////////////////
+///
+/// Event loop
+///
+
+#ifndef YUE_IO_READ_CAP
+#define YUE_IO_READ_CAP 4096
+#endif
+
+typedef struct yue_IOTask {
+    // the task's coroutine, NULL when the slot is free
+    yue_Object *co;
+    // the fd it's parked on, -1 when it's not waiting for one
+    int fd;
+    bool parked;
+} yue_IOTask;
+
+typedef struct yue_Timer {
+    double deadline;
+    size_t slot;
+} yue_Timer;
+
+typedef struct yue_Loop {
+    int epfd;
+    yue_IOTask *tasks;
+    size_t count_tasks;
+    size_t cap_tasks;
+    size_t *free_slots;
+    size_t count_free;
+    size_t cap_free;
+    // slots of tasks that can run
+    size_t *ready;
+    size_t count_ready;
+    size_t cap_ready;
+    // binary heap ordered by deadline
+    yue_Timer *timers;
+    size_t count_timers;
+    size_t cap_timers;
+    size_t count_live;
+    size_t count_waiting;
+} yue_Loop;
+
+static void *_yue_io_grow(yue_Context *ctx, void *items, size_t *cap, size_t count, size_t itemsz)
+{
+    if(count < *cap) return items;
+    size_t newcap = *cap ? *cap * 2 : 64;
+    void *res = realloc(items, newcap * itemsz);
+    if(!res) yue_error(ctx, "Could not grow the event loop");
+    *cap = newcap;
+    return res;
+}
+
+static double _yue_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static yue_Loop *_yue_loop_get(yue_Context *ctx)
+{
+    if(ctx->loop) return ctx->loop;
+    yue_Loop *loop = calloc(1, sizeof(*loop));
+    if(!loop) yue_error(ctx, "Could not allocate the event loop");
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epfd < 0) {
+        free(loop);
+        yue_error(ctx, "Could not create the event loop: %s", strerror(errno));
+    }
+    ctx->loop = loop;
+    return loop;
+}
+
+static void _yue_loop_mark(yue_Context *ctx)
+{
+    yue_Loop *loop = ctx->loop;
+    for(size_t i = 0; i < loop->count_tasks; ++i) {
+        if(loop->tasks[i].co) mark(ctx, loop->tasks[i].co);
+    }
+}
+
+static void _yue_loop_close(yue_Context *ctx)
+{
+    yue_Loop *loop = ctx->loop;
+    for(size_t i = 0; i < loop->count_tasks; ++i) {
+        if(loop->tasks[i].co) loop->tasks[i].co->as_coroutine->io_slot = 0;
+    }
+    close(loop->epfd);
+    free(loop->tasks);
+    free(loop->free_slots);
+    free(loop->ready);
+    free(loop->timers);
+    free(loop);
+    ctx->loop = NULL;
+}
+
+static void _yue_loop_ready(yue_Context *ctx, yue_Loop *loop, size_t slot)
+{
+    loop->ready = _yue_io_grow(ctx, loop->ready, &loop->cap_ready, loop->count_ready, sizeof(size_t));
+    loop->ready[loop->count_ready++] = slot;
+}
+
+// Drops the first n ready slots
+static void _yue_loop_consume(yue_Loop *loop, size_t n)
+{
+    memmove(loop->ready, loop->ready + n, (loop->count_ready - n) * sizeof(size_t));
+    loop->count_ready -= n;
+}
+
+static void _yue_loop_remove(yue_Loop *loop, size_t slot)
+{
+    // free_slots has room for every slot
+    loop->tasks[slot].co->as_coroutine->io_slot = 0;
+    loop->tasks[slot].co = NULL;
+    loop->free_slots[loop->count_free++] = slot;
+    loop->count_live -= 1;
+}
+
+static void _yue_timer_push(yue_Context *ctx, yue_Loop *loop, double deadline, size_t slot)
+{
+    loop->timers = _yue_io_grow(ctx, loop->timers, &loop->cap_timers, loop->count_timers, sizeof(yue_Timer));
+    size_t i = loop->count_timers++;
+    while(i > 0 && loop->timers[(i - 1) / 2].deadline > deadline) {
+        loop->timers[i] = loop->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    loop->timers[i] = (yue_Timer){ .deadline = deadline, .slot = slot };
+}
+
+static size_t _yue_timer_pop(yue_Loop *loop)
+{
+    size_t slot = loop->timers[0].slot;
+    yue_Timer last = loop->timers[--loop->count_timers];
+    size_t i = 0;
+    for(;;) {
+        size_t child = 2 * i + 1;
+        if(child >= loop->count_timers) break;
+        if(child + 1 < loop->count_timers && loop->timers[child + 1].deadline < loop->timers[child].deadline)
+            child += 1;
+        if(loop->timers[child].deadline >= last.deadline) break;
+        loop->timers[i] = loop->timers[child];
+        i = child;
+    }
+    if(loop->count_timers > 0) loop->timers[i] = last;
+    return slot;
+}
+
+// Parks the running task until fd (-1 for none) is ready for events or the deadline
+// (-1 for none) has passed. Returns false when it's not running in a task.
+static bool _yue_io_park(yue_Context *ctx, int fd, uint32_t events, double deadline)
+{
+    yue_Coroutine *co = ctx->coroutine;
+    yue_Loop *loop = ctx->loop;
+    if(!co || !co->io_slot || !loop) return false;
+    size_t slot = co->io_slot - 1;
+    if(fd >= 0) {
+        struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.u64 = slot };
+        if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            // regular files can't be polled, they're always ready
+            if(errno == EPERM) return true;
+            if(errno == EEXIST) yue_error(ctx, "Another task is already waiting on this fd");
+            yue_error(ctx, "Could not wait on fd %d: %s", fd, strerror(errno));
+        }
+        loop->count_waiting += 1;
+    }
+    if(deadline >= 0) _yue_timer_push(ctx, loop, deadline, slot);
+    loop->tasks[slot].fd     = fd;
+    loop->tasks[slot].parked = true;
+    co->value = yue_nil(ctx);
+    _yue_fiber_switch(&co->fiber, &co->caller);
+    return true;
+}
+
+static void _yue_io_await(yue_Context *ctx, int fd, bool write)
+{
+    if(_yue_io_park(ctx, fd, write ? EPOLLOUT : EPOLLIN, -1)) return;
+    struct pollfd p = { .fd = fd, .events = write ? POLLOUT : POLLIN };
+    while(poll(&p, 1, -1) < 0 && errno == EINTR);
+}
+
+static void _yue_io_destroy(void *data)
+{
+    int fd = (int)(intptr_t)data;
+    if(fd >= 0) close(fd);
+}
+
+// fds are resources so the ones scripts forget about are closed by the GC
+static yue_Object *_yue_io_wrap(yue_Context *ctx, int fd)
+{
+    return yue_resource(ctx, (void*)(intptr_t)fd, _yue_io_destroy);
+}
+
+static int _yue_io_fd(yue_Context *ctx, yue_Object *obj, const char *name)
+{
+    if(obj->type != YUE_OBJECT_RESOURCE || obj->as_resource.destroy != _yue_io_destroy) 
+        yue_error(ctx, "`%s` requires an fd but found %s", name, _yue_type_names[obj->type]);
+    int fd = (int)(intptr_t)obj->as_resource.data;
+    if(fd < 0) yue_error(ctx, "`%s` on a closed fd", name);
+    return fd;
+}
+
+static void _yue_io_nonblock(yue_Context *ctx, int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) 
+        yue_error(ctx, "Could not make fd %d non-blocking: %s", fd, strerror(errno));
+}
+
+static int _yue_io_socket(yue_Context *ctx, yue_Object *host, yue_Object *port, struct sockaddr_in *addr)
+{
+    char name[64];
+    if(host->type != YUE_OBJECT_STRING || port->type != YUE_OBJECT_NUMBER)
+        yue_error(ctx, "Expected a host string and a port number");
+    yue_tostring(ctx, host, name, sizeof(name));
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port   = htons((uint16_t)port->as_number);
+    if(inet_pton(AF_INET, name, &addr->sin_addr) != 1) yue_error(ctx, "Invalid IPv4 address '%s'", name);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) yue_error(ctx, "Could not create a socket: %s", strerror(errno));
+    return fd;
+}
+
+// (spawn fn args...)
+// Starts fn as a task of the event loop, it runs on the next `run`
+yue_Object *yue_builtin_spawn(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Loop *loop = _yue_loop_get(ctx);
+    yue_Object *obj = yue_builtin_coroutine(ctx, arg);
+    yue_nextarg(ctx, &arg);
+    yue_Coroutine *co = obj->as_coroutine;
+    co->value = _eval_list(ctx, arg);
+
+    size_t slot;
+    if(loop->count_free > 0) {
+        slot = loop->free_slots[--loop->count_free];
+    } else {
+        loop->tasks = _yue_io_grow(ctx, loop->tasks, &loop->cap_tasks, loop->count_tasks, sizeof(yue_IOTask));
+        loop->free_slots = _yue_io_grow(ctx, loop->free_slots, &loop->cap_free, loop->count_tasks, sizeof(size_t));
+        slot = loop->count_tasks++;
+    }
+    loop->tasks[slot] = (yue_IOTask){ .co = obj, .fd = -1, .parked = false };
+    loop->count_live += 1;
+    co->io_slot = slot + 1;
+    _yue_loop_ready(ctx, loop, slot);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, obj);
+    return obj;
+}
+
+// (run)
+// Runs the tasks until every one is done. An error in a task stops the loop
+// and continues in the caller, the other tasks run on the next `run`.
+yue_Object *yue_builtin_run(yue_Context *ctx, yue_Object *arg)
+{
+    (void)arg;
+    yue_Loop *loop = ctx->loop;
+    if(!loop) return yue_nil(ctx);
+    if(ctx->coroutine && ctx->coroutine->io_slot) yue_error(ctx, "`run` inside of a task");
+
+    struct epoll_event events[64];
+    while(loop->count_live > 0) {
+        // only the tasks that were ready before this round, so that tasks 
+        // that keep yielding can't starve the ones waiting on fds
+        size_t count = loop->count_ready;
+        for(size_t i = 0; i < count; ++i) {
+            size_t slot = loop->ready[i];
+            yue_Coroutine *co = loop->tasks[slot].co->as_coroutine;
+            _yue_coroutine_resume(ctx, co);
+            co->value = yue_nil(ctx);
+            if(co->state == YUE_COROUTINE_DEAD) {
+                _yue_loop_remove(loop, slot);
+                if(co->status != YUE_OK) {
+                    _yue_loop_consume(loop, i + 1);
+                    _yue_throw(ctx, co->status);
+                }
+            } else if(!loop->tasks[slot].parked) {
+                // a plain yield
+                _yue_loop_ready(ctx, loop, slot);
+            }
+        }
+        _yue_loop_consume(loop, count);
+        if(loop->count_live == 0) break;
+
+        int timeout = -1;
+        if(loop->count_ready > 0) {
+            timeout = 0;
+        } else if(loop->count_timers > 0) {
+            double ms = loop->timers[0].deadline - _yue_now_ms();
+            timeout = ms <= 0 ? 0 : (int)ms + 1;
+        } else if(loop->count_waiting == 0) {
+            yue_error(ctx, "Every task is waiting but nothing can wake them up");
+        }
+        int n = epoll_wait(loop->epfd, events, sizeof(events) / sizeof(events[0]), timeout);
+        if(n < 0 && errno != EINTR) yue_error(ctx, "Could not wait for events: %s", strerror(errno));
+        for(int i = 0; i < n; ++i) {
+            size_t slot = events[i].data.u64;
+            yue_IOTask *task = &loop->tasks[slot];
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, task->fd, NULL);
+            loop->count_waiting -= 1;
+            task->fd     = -1;
+            task->parked = false;
+            _yue_loop_ready(ctx, loop, slot);
+        }
+        double now = _yue_now_ms();
+        while(loop->count_timers > 0 && loop->timers[0].deadline <= now) {
+            size_t slot = _yue_timer_pop(loop);
+            loop->tasks[slot].parked = false;
+            _yue_loop_ready(ctx, loop, slot);
+        }
+    }
+    return yue_nil(ctx);
+}
+
+// (await fd) or (await fd "w")
+// Waits until fd is readable, or writable with "w"
+yue_Object *yue_builtin_await(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    int fd = _yue_io_fd(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "await");
+    bool write = false;
+    if(arg->type == YUE_OBJECT_PAIR) {
+        yue_Object *mode = yue_eval(ctx, yue_nextarg(ctx, &arg));
+        char name[4];
+        write = mode->type == YUE_OBJECT_STRING && strcmp(yue_tostring(ctx, mode, name, sizeof(name)), "w") == 0;
+    }
+    yue_restoregc(ctx, gc);
+    _yue_io_await(ctx, fd, write);
+    return yue_nil(ctx);
+}
+
+// (sleep ms)
+yue_Object *yue_builtin_sleep(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *ms = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    if(ms->type != YUE_OBJECT_NUMBER) yue_error(ctx, "`sleep` requires a number of milliseconds");
+    double deadline = _yue_now_ms() + ms->as_number;
+    if(_yue_io_park(ctx, -1, 0, deadline)) return yue_nil(ctx);
+    struct timespec ts = { 
+        .tv_sec  = (time_t)(ms->as_number / 1000), 
+        .tv_nsec = (long)(ms->as_number - (time_t)(ms->as_number / 1000) * 1000.0) * 1000000L,
+    };
+    while(nanosleep(&ts, &ts) < 0 && errno == EINTR);
+    return yue_nil(ctx);
+}
+
+// (pipe), a list of the read and the write end
+yue_Object *yue_builtin_pipe(yue_Context *ctx, yue_Object *arg)
+{
+    (void)arg;
+    size_t gc = yue_savegc(ctx);
+    yue_Object *ends[2] = { _yue_io_wrap(ctx, -1), _yue_io_wrap(ctx, -1) };
+    int fds[2];
+    if(pipe(fds) < 0) yue_error(ctx, "Could not create a pipe: %s", strerror(errno));
+    for(int i = 0; i < 2; ++i) {
+        ends[i]->as_resource.data = (void*)(intptr_t)fds[i];
+        _yue_io_nonblock(ctx, fds[i]);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    yue_Object *res = yue_list(ctx, ends, 2);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (open-file path mode), mode is "r", "w" or "a"
+yue_Object *yue_builtin_open_file(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *path = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_Object *mode = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    if(path->type != YUE_OBJECT_STRING || mode->type != YUE_OBJECT_STRING)
+        yue_error(ctx, "`open-file` requires a path and a mode");
+    char name[1024], how[4];
+    yue_tostring(ctx, path, name, sizeof(name));
+    yue_tostring(ctx, mode, how, sizeof(how));
+    int flags = O_RDONLY;
+    if(strcmp(how, "w") == 0) flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if(strcmp(how, "a") == 0) flags = O_WRONLY | O_CREAT | O_APPEND;
+    else if(strcmp(how, "r") != 0) yue_error(ctx, "`open-file` mode must be \"r\", \"w\" or \"a\"");
+
+    yue_Object *res = _yue_io_wrap(ctx, -1);
+    int fd = open(name, flags | O_NONBLOCK | O_CLOEXEC, 0644);
+    if(fd < 0) yue_error(ctx, "Could not open '%s': %s", name, strerror(errno));
+    res->as_resource.data = (void*)(intptr_t)fd;
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (fd-read fd n)
+// A string of at most n (YUE_IO_READ_CAP by default) bytes, nil at the end of the stream
+yue_Object *yue_builtin_fd_read(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, obj);
+    size_t n = YUE_IO_READ_CAP;
+    if(arg->type == YUE_OBJECT_PAIR) {
+        yue_Object *count = yue_eval(ctx, yue_nextarg(ctx, &arg));
+        if(count->type != YUE_OBJECT_NUMBER || count->as_number < 1) 
+            yue_error(ctx, "`fd-read` requires a positive count");
+        if(count->as_number < YUE_IO_READ_CAP) n = (size_t)count->as_number;
+    }
+    char buf[YUE_IO_READ_CAP];
+    for(;;) {
+        // the fd may have been closed by another task while this one was parked
+        int fd = _yue_io_fd(ctx, obj, "fd-read");
+        ssize_t r = read(fd, buf, n);
+        if(r >= 0) {
+            yue_restoregc(ctx, gc);
+            return r == 0 ? yue_nil(ctx) : yue_string_sized(ctx, buf, r);
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            _yue_io_await(ctx, fd, false);
+        } else if(errno != EINTR) {
+            yue_error(ctx, "`fd-read` failed: %s", strerror(errno));
+        }
+    }
+}
+
+static void _yue_io_write_all(yue_Context *ctx, yue_Object *obj, const char *buf, size_t n)
+{
+    while(n > 0) {
+        int fd = _yue_io_fd(ctx, obj, "fd-write");
+        ssize_t r = write(fd, buf, n);
+        if(r >= 0) {
+            buf += r;
+            n   -= r;
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            _yue_io_await(ctx, fd, true);
+        } else if(errno != EINTR) {
+            yue_error(ctx, "`fd-write` failed: %s", strerror(errno));
+        }
+    }
+}
+
+// (fd-write fd str), returns the number of bytes written
+yue_Object *yue_builtin_fd_write(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, obj);
+    yue_Object *str = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, str);
+    if(str->type != YUE_OBJECT_STRING) yue_error(ctx, "`fd-write` requires a string");
+    _yue_io_fd(ctx, obj, "fd-write");
+
+    // strings are chunked, they're written through a buffer instead of being copied whole
+    char buf[YUE_IO_READ_CAP];
+    size_t len = 0, total = 0;
+    for(yue_Object *curr = str; curr; curr = curr->as_str.tail) {
+        for(size_t i = 0; i < YUE_STRING_DATA_SIZE && curr->as_str.data[i]; ++i) {
+            if(len == sizeof(buf)) {
+                _yue_io_write_all(ctx, obj, buf, len);
+                total += len;
+                len = 0;
+            }
+            buf[len++] = curr->as_str.data[i];
+        }
+    }
+    _yue_io_write_all(ctx, obj, buf, len);
+    total += len;
+    yue_restoregc(ctx, gc);
+    return yue_number(ctx, (yue_Number)total);
+}
+
+// (fd-close fd)
+yue_Object *yue_builtin_fd_close(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_restoregc(ctx, gc);
+    int fd = _yue_io_fd(ctx, obj, "fd-close");
+    // tasks parked on it would never be woken up, they see the closed fd instead
+    yue_Loop *loop = ctx->loop;
+    for(size_t i = 0; loop && loop->count_waiting > 0 && i < loop->count_tasks; ++i) {
+        yue_IOTask *task = &loop->tasks[i];
+        if(task->co && task->parked && task->fd == fd) {
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+            loop->count_waiting -= 1;
+            task->fd     = -1;
+            task->parked = false;
+            _yue_loop_ready(ctx, loop, i);
+        }
+    }
+    obj->as_resource.data = (void*)(intptr_t)-1;
+    close(fd);
+    return yue_nil(ctx);
+}
+
+// (tcp-listen host port)
+yue_Object *yue_builtin_tcp_listen(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *host = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, host);
+    yue_Object *port = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, port);
+    yue_Object *res = _yue_io_wrap(ctx, -1);
+    struct sockaddr_in addr;
+    int fd = _yue_io_socket(ctx, host, port, &addr);
+    res->as_resource.data = (void*)(intptr_t)fd;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+        yue_error(ctx, "Could not listen on port %d: %s", (int)port->as_number, strerror(errno));
+    _yue_io_nonblock(ctx, fd);
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (tcp-port fd), the local port of a socket
+yue_Object *yue_builtin_tcp_port(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    int fd = _yue_io_fd(ctx, yue_eval(ctx, yue_nextarg(ctx, &arg)), "tcp-port");
+    yue_restoregc(ctx, gc);
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(getsockname(fd, (struct sockaddr*)&addr, &len) < 0) 
+        yue_error(ctx, "`tcp-port` failed: %s", strerror(errno));
+    return yue_number(ctx, ntohs(addr.sin_port));
+}
+
+// (tcp-accept fd), the connection's fd
+yue_Object *yue_builtin_tcp_accept(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *obj = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, obj);
+    yue_Object *res = _yue_io_wrap(ctx, -1);
+    for(;;) {
+        int fd = _yue_io_fd(ctx, obj, "tcp-accept");
+        int conn = accept(fd, NULL, NULL);
+        if(conn >= 0) {
+            res->as_resource.data = (void*)(intptr_t)conn;
+            fcntl(conn, F_SETFD, FD_CLOEXEC);
+            _yue_io_nonblock(ctx, conn);
+            break;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            _yue_io_await(ctx, fd, false);
+        } else if(errno != EINTR && errno != ECONNABORTED) {
+            yue_error(ctx, "`tcp-accept` failed: %s", strerror(errno));
+        }
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// (tcp-connect host port)
+yue_Object *yue_builtin_tcp_connect(yue_Context *ctx, yue_Object *arg)
+{
+    size_t gc = yue_savegc(ctx);
+    yue_Object *host = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, host);
+    yue_Object *port = yue_eval(ctx, yue_nextarg(ctx, &arg));
+    yue_pushgc(ctx, port);
+    yue_Object *res = _yue_io_wrap(ctx, -1);
+    struct sockaddr_in addr;
+    int fd = _yue_io_socket(ctx, host, port, &addr);
+    res->as_resource.data = (void*)(intptr_t)fd;
+    _yue_io_nonblock(ctx, fd);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if(errno != EINPROGRESS) yue_error(ctx, "Could not connect: %s", strerror(errno));
+        _yue_io_await(ctx, fd, true);
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0) yue_error(ctx, "Could not connect: %s", strerror(err));
+    }
+    yue_restoregc(ctx, gc);
+    yue_pushgc(ctx, res);
+    return res;
+}
+
+// bound as they're used like the other builtins
+static yue_Builtin _yue_io_builtins[] = {
+    YUE_BUILTIN("spawn",       yue_builtin_spawn),
+    YUE_BUILTIN("run",         yue_builtin_run),
+    YUE_BUILTIN("await",       yue_builtin_await),
+    YUE_BUILTIN("sleep",       yue_builtin_sleep),
+    YUE_BUILTIN("pipe",        yue_builtin_pipe),
+    YUE_BUILTIN("open-file",   yue_builtin_open_file),
+    YUE_BUILTIN("fd-read",     yue_builtin_fd_read),
+    YUE_BUILTIN("fd-write",    yue_builtin_fd_write),
+    YUE_BUILTIN("fd-close",    yue_builtin_fd_close),
+    YUE_BUILTIN("tcp-listen",  yue_builtin_tcp_listen),
+    YUE_BUILTIN("tcp-port",    yue_builtin_tcp_port),
+    YUE_BUILTIN("tcp-accept",  yue_builtin_tcp_accept),
+    YUE_BUILTIN("tcp-connect", yue_builtin_tcp_connect),
+};
+
+void yue_load_io(yue_Context *ctx)
+{
+    ctx->io = true;
+}
+
+#endif // __linux__
+
+// Binds a builtin of the tables loaded in ctx as a global, NULL when none has this name
+static yue_Object *_yue_builtin_get(yue_Context *ctx, const char *name)
+{
+    yue_Object *value = NULL;
+    size_t count = sizeof(_yue_builtins) / sizeof(*_yue_builtins);
+    for(size_t i = 0; ctx->builtins && !value && i < count; ++i) {
+        if(strcmp(_yue_builtins[i].name, name) == 0) value = &_yue_builtins[i].fn;
+    }
+#if defined(__linux__)
+    count = sizeof(_yue_io_builtins) / sizeof(*_yue_io_builtins);
+    for(size_t i = 0; ctx->io && !value && i < count; ++i) {
+        if(strcmp(_yue_io_builtins[i].name, name) == 0) value = &_yue_io_builtins[i].fn;
+    }
+#endif
+    if(!value) return NULL;
+    _yue_bind_global(ctx, name, value);
+    return value;
+}
 
 #endif // YUE_IMPLEMENTATION